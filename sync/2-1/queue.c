@@ -4,22 +4,18 @@
 
 #include "queue.h"
 
-void *qmonitor(void *arg) {
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
 	queue_t *q = (queue_t *)arg;
 
-	printf("qmonitor: [%d %d %d]\n", getpid(), getppid(), gettid());
-
-	while (1) {
-		queue_print_stats(q);
-		sleep(1);
-	}
-
-	return NULL;
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
 }
 
 queue_t* queue_init(int max_count) {
-	int err;
-
 	queue_t *q = malloc(sizeof(queue_t));
 	if (!q) {
 		printf("Cannot allocate memory for a queue\n");
@@ -34,16 +30,14 @@ queue_t* queue_init(int max_count) {
 	q->add_attempts = q->get_attempts = 0;
 	q->add_count = q->get_count = 0;
 
-	err = pthread_create(&q->qmonitor_tid, NULL, qmonitor, q);
-	if (err) {
-		printf("queue_init: pthread_create() failed: %s\n", strerror(err));
-		abort();
-	}
+	q->mon = qmon_register(q, queue_sample);
 
 	return q;
 }
 
 void queue_destroy(queue_t *q) {
+    qmon_unregister(q->mon);
+
     qnode_t *current = q->first;
     while (current != NULL) {
         qnode_t *temp = current;
@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "qmon.h"
+
 typedef struct _QueueNode {
 	int val;
 	struct _QueueNode *next;
@@ -18,7 +20,7 @@ typedef struct _Queue {
 	qnode_t *first;
 	qnode_t *last;
 
-	pthread_t qmonitor_tid;
+	qmon_entry_t *mon;
 
 	int count;
 	int max_count;
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * One epoll loop serving many queues through their QUEUE_EV_NON_EMPTY
+ * eventfds. Producers stamp every value when adding it to one of the
+ * queues (values are indices into the stamp array); the consumer waits in
+ * epoll_wait, drains every ready queue and computes the add->get latency.
+ * Reports latency percentiles and syscalls per message: epoll_wait and
+ * read() in the consumer, eventfd write() in the producers (the sum of
+ * the eventfd counters read back).
+ * With interval_us > 0 each producer pauses between adds, so queues
+ * mostly run empty and every message pays for a wakeup.
+ * Also linked against 2-2/b.
+ * usage: queue-epoll [queues] [producers] [ops] [interval_us]
+ */
+
+#ifndef VARIANT
+#define VARIANT "queue"
+#endif
+
+#define MAX_EVENTS 64
+
+static int nqueues = 64, producers = 2;
+static long ops = 200000, interval_us = 0;
+
+static queue_t **queues;
+static long *stamps;
+static long *latency;
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void *writer(void *arg) {
+	long id = (long)arg;
+	struct timespec pause = { .tv_sec = 0, .tv_nsec = interval_us * 1000 };
+
+	for (long v = id; v < ops; v += producers) {
+		queue_t *q = queues[v % nqueues];
+
+		stamps[v] = now_ns();
+		while (!queue_add(q, v))
+			;
+
+		if (interval_us)
+			nanosleep(&pause, NULL);
+	}
+
+	return NULL;
+}
+
+static int cmp_long(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+	struct epoll_event evs[MAX_EVENTS];
+	long waits = 0, reads = 0, writes = 0, got = 0;
+	int err;
+
+	if (argc > 1)
+		nqueues = atoi(argv[1]);
+	if (argc > 2)
+		producers = atoi(argv[2]);
+	if (argc > 3)
+		ops = atol(argv[3]);
+	if (argc > 4)
+		interval_us = atol(argv[4]);
+
+	if (nqueues < 1 || producers < 1 || ops < 1 || interval_us < 0 || interval_us >= 1000000) {
+		printf("usage: %s [queues] [producers] [ops] [interval_us < 1000000]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queues = malloc(nqueues * sizeof(queue_t *));
+	stamps = malloc(ops * sizeof(long));
+	latency = malloc(ops * sizeof(long));
+	if (!queues || !stamps || !latency) {
+		printf("Cannot allocate memory for the benchmark\n");
+		return -1;
+	}
+
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+
+	for (int i = 0; i < nqueues; i++) {
+		queues[i] = queue_init(1024);
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, queue_event_fd(queues[i], QUEUE_EV_NON_EMPTY), &ev)) {
+			perror("epoll_ctl");
+			return -1;
+		}
+	}
+
+	pthread_t tids[producers];
+	long start = now_ns();
+
+	for (long i = 0; i < producers; i++) {
+		err = pthread_create(&tids[i], NULL, writer, (void *)i);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	while (got < ops) {
+		int n = epoll_wait(ep, evs, MAX_EVENTS, -1);
+		waits++;
+
+		for (int e = 0; e < n; e++) {
+			queue_t *q = queues[evs[e].data.u32];
+			uint64_t cnt;
+			int v;
+
+			if (read(queue_event_fd(q, QUEUE_EV_NON_EMPTY), &cnt, sizeof(cnt)) == sizeof(cnt))
+				writes += cnt;
+			reads++;
+
+			// drain until empty: the failing get re-arms the eventfd
+			while (queue_get(q, &v)) {
+				latency[got++] = now_ns() - stamps[v];
+			}
+		}
+	}
+
+	double secs = (now_ns() - start) / 1e9;
+
+	for (int i = 0; i < producers; i++)
+		pthread_join(tids[i], NULL);
+
+	qsort(latency, ops, sizeof(long), cmp_long);
+
+	printf("epoll: %-6s queues %4d producers %2d interval %5ldus: %10.0f msgs/s latency p50 %.1fus p99 %.1fus max %.1fus; "
+		"syscalls/msg %.3f (epoll_wait %.3f read %.3f write %.3f)\n",
+		VARIANT, nqueues, producers, interval_us, ops / secs,
+		latency[ops / 2] / 1e3, latency[ops * 99 / 100] / 1e3, latency[ops - 1] / 1e3,
+		(double)(waits + reads + writes) / ops,
+		(double)waits / ops, (double)reads / ops, (double)writes / ops);
+
+	for (int i = 0; i < nqueues; i++)
+		queue_destroy(queues[i]);
+	close(ep);
+
+	return 0;
+}
@@ -4,23 +4,143 @@
 
 #include "queue.h"
 
-void *qmonitor(void *arg) {
-	queue_t *q = (queue_t *)arg;
+static void pool_init(queue_t *q) {
+	q->pool = malloc(q->max_count * sizeof(qnode_t));
+	if (!q->pool) {
+		printf("Cannot allocate memory for node pool\n");
+		abort();
+	}
+
+	q->free_list = NULL;
+	for (int i = q->max_count - 1; i >= 0; i--) {
+		q->pool[i].next = q->free_list;
+		q->free_list = &q->pool[i];
+	}
+
+	q->allocs = 0;
+}
 
-	printf("qmonitor: [%d %d %d]\n", getpid(), getppid(), gettid());
+// callers hold the queue lock
+static qnode_t *node_alloc(queue_t *q) {
+	qnode_t *n = q->free_list;
 
-	while (1) {
-		queue_print_stats(q);
-		sleep(1);
+	if (n) {
+		q->free_list = n->next;
+		return n;
 	}
 
-	return NULL;
+	n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	q->allocs++;
+
+	return n;
 }
 
-queue_t* queue_init(int max_count) {
-	int err;
+static void node_free(queue_t *q, qnode_t *n) {
+	n->next = q->free_list;
+	q->free_list = n;
+}
+
+static void pool_destroy(queue_t *q) {
+	qnode_t *n = q->free_list;
 
-	queue_t *q = malloc(sizeof(queue_t));
+	while (n) {
+		qnode_t *next = n->next;
+		if (n < q->pool || n >= q->pool + q->max_count)
+			free(n);
+		n = next;
+	}
+
+	free(q->pool);
+}
+
+static _Atomic unsigned long queue_ids;
+
+// the last queue this thread used and its counters there
+static __thread unsigned long stats_queue_id;
+static __thread qstats_t *stats_slot;
+
+static qstats_t *queue_stats(queue_t *q) {
+	if (stats_queue_id == q->id)
+		return stats_slot;
+
+	pthread_t self = pthread_self();
+	qstats_t *st;
+
+	for (st = atomic_load(&q->stats); st; st = st->next)
+		if (pthread_equal(st->owner, self))
+			break;
+
+	if (!st) {
+		st = aligned_alloc(CACHE_LINE, sizeof(qstats_t));
+		if (!st) {
+			printf("Cannot allocate memory for queue stats\n");
+			abort();
+		}
+		memset(st, 0, sizeof(qstats_t));
+		st->owner = self;
+
+		st->next = atomic_load(&q->stats);
+		while (!atomic_compare_exchange_weak(&q->stats, &st->next, st))
+			;
+	}
+
+	stats_queue_id = q->id;
+	stats_slot = st;
+
+	return st;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->lock_ops = 0;
+	for (qstats_t *st = atomic_load(&q->stats); st; st = st->next) {
+		s->add_attempts += st->add_attempts;
+		s->get_attempts += st->get_attempts;
+		s->add_count += st->add_count;
+		s->get_count += st->get_count;
+		s->lock_ops += st->lock_ops;
+	}
+	s->count = q->count;
+	s->allocs = q->allocs;
+	s->syscalls = q->ev_writes;
+}
+
+/*
+ * Edge-style eventfd notification, called with the lock held.
+ * An event fires (one write) only while armed, and only a caller that
+ * saw the opposite condition re-arms it: a get on an empty queue for
+ * non-empty, an add on a full one for non-full. The write itself is
+ * done by ev_signal() after unlocking, so no syscall runs under the lock.
+ */
+static int ev_fire(queue_t *q, int event) {
+    if (q->ev_fd[event] < 0 || !q->ev_armed[event])
+        return -1;
+
+    q->ev_armed[event] = 0;
+    q->ev_writes++;
+
+    return q->ev_fd[event];
+}
+
+static void ev_arm(queue_t *q, int event) {
+    q->ev_armed[event] = 1;
+}
+
+static void ev_signal(int fd) {
+    uint64_t one = 1;
+
+    if (fd >= 0 && write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("queue: eventfd write");
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
 	if (!q) {
 		printf("Cannot allocate memory for a queue\n");
 		abort();
@@ -31,42 +151,64 @@ queue_t* queue_init(int max_count) {
 	q->max_count = max_count;
 	q->count = 0;
 
-	q->add_attempts = q->get_attempts = 0;
-	q->add_count = q->get_count = 0;
+	q->id = atomic_fetch_add(&queue_ids, 1) + 1;
+	atomic_store(&q->stats, NULL);
 
-	err = pthread_create(&q->qmonitor_tid, NULL, qmonitor, q);
-	if (err) {
-		printf("queue_init: pthread_create() failed: %s\n", strerror(err));
-		abort();
+	q->last_get_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	pool_init(q);
+
+	for (int e = 0; e < QUEUE_EV_COUNT; e++) {
+		q->ev_fd[e] = -1;
+		q->ev_armed[e] = 0;
 	}
+	q->ev_writes = 0;
+
+	pthread_mutex_init(&q->lock, NULL);
+
+	q->mon = qmon_register(q, queue_sample);
 
 	return q;
 }
 
 void queue_destroy(queue_t *q) {
+    qmon_unregister(q->mon);
+
     qnode_t *current = q->first;
     while (current != NULL) {
         qnode_t *temp = current;
         current = current->next;
-        free(temp);
+        node_free(q, temp);
+    }
+    pool_destroy(q);
+    qstats_t *st = atomic_load(&q->stats);
+    while (st) {
+        qstats_t *next = st->next;
+        free(st);
+        st = next;
     }
+    for (int e = 0; e < QUEUE_EV_COUNT; e++)
+        if (q->ev_fd[e] >= 0)
+            close(q->ev_fd[e]);
+    pthread_mutex_destroy(&q->lock);
     free(q);
 }
 
 int queue_add(queue_t *q, int val) {
+    qstats_t *st = queue_stats(q);
+
     pthread_mutex_lock(&q->lock);
+    st->lock_ops++;
 
-    q->add_attempts++;
+    st->add_attempts++;
     if (q->count == q->max_count) {
+        ev_arm(q, QUEUE_EV_NON_FULL);
         pthread_mutex_unlock(&q->lock);
         return 0;
     }
 
-    qnode_t *new = malloc(sizeof(qnode_t));
-    if (!new) {
-        printf("Cannot allocate memory for new node\n");
-        abort();
-    }
+    qnode_t *new = node_alloc(q);
     new->val = val;
     new->next = NULL;
 
@@ -78,17 +220,24 @@ int queue_add(queue_t *q, int val) {
     }
 
     q->count++;
-    q->add_count++;
+    st->add_count++;
 
+    int fd = ev_fire(q, QUEUE_EV_NON_EMPTY);
     pthread_mutex_unlock(&q->lock);
+
+    ev_signal(fd);
     return 1;
 }
 
 int queue_get(queue_t *q, int *val) {
+    qstats_t *st = queue_stats(q);
+
     pthread_mutex_lock(&q->lock);
+    st->lock_ops++;
 
-    q->get_attempts++;
+    st->get_attempts++;
     if (q->count == 0) {
+        ev_arm(q, QUEUE_EV_NON_EMPTY);
         pthread_mutex_unlock(&q->lock);
         return 0;
     }
@@ -96,18 +245,155 @@ int queue_get(queue_t *q, int *val) {
     qnode_t *tmp = q->first;
     *val = tmp->val;
     q->first = q->first->next;
-    free(tmp);
+    node_free(q, tmp);
     q->count--;
-    q->get_count++;
+    st->get_count++;
 
+    int fd = ev_fire(q, QUEUE_EV_NON_FULL);
     pthread_mutex_unlock(&q->lock);
+
+    ev_signal(fd);
     return 1;
 }
 
+int queue_add_many(queue_t *q, const int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    qstats_t *st = queue_stats(q);
+
+    pthread_mutex_lock(&q->lock);
+    st->lock_ops++;
+
+    // one attempt per value, so attempts - count stays the values refused
+    st->add_attempts += n;
+    int k = q->max_count - q->count;
+    if (k > n)
+        k = n;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *new = node_alloc(q);
+        new->val = vals[i];
+        new->next = NULL;
+
+        if (!q->first)
+            q->first = q->last = new;
+        else {
+            q->last->next = new;
+            q->last = new;
+        }
+    }
+
+    q->count += k;
+    st->add_count += k;
+
+    int fd = -1;
+    if (k)
+        fd = ev_fire(q, QUEUE_EV_NON_EMPTY);
+    else
+        ev_arm(q, QUEUE_EV_NON_FULL);
+    pthread_mutex_unlock(&q->lock);
+
+    ev_signal(fd);
+    return k;
+}
+
+int queue_get_many(queue_t *q, int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    qstats_t *st = queue_stats(q);
+
+    pthread_mutex_lock(&q->lock);
+    st->lock_ops++;
+
+    st->get_attempts += n;
+    int k = q->count;
+    if (k > n)
+        k = n;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *tmp = q->first;
+        vals[i] = tmp->val;
+        q->first = q->first->next;
+        node_free(q, tmp);
+    }
+
+    q->count -= k;
+    st->get_count += k;
+
+    int fd = -1;
+    if (k)
+        fd = ev_fire(q, QUEUE_EV_NON_FULL);
+    else
+        ev_arm(q, QUEUE_EV_NON_EMPTY);
+    pthread_mutex_unlock(&q->lock);
+
+    ev_signal(fd);
+    return k;
+}
+
+int queue_event_fd(queue_t *q, int event) {
+    assert(event >= 0 && event < QUEUE_EV_COUNT);
+
+    // no syscalls under the lock: create the eventfd first, and drop it
+    // if another thread installed one meanwhile
+    int fd = -1, fire = -1;
+
+    pthread_mutex_lock(&q->lock);
+    int have = q->ev_fd[event] >= 0;
+    pthread_mutex_unlock(&q->lock);
+
+    if (!have && (fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        return -1;
+
+    pthread_mutex_lock(&q->lock);
+
+    if (q->ev_fd[event] < 0) {
+        q->ev_fd[event] = fd;
+        fd = -1;
+
+        // fire right away if the event is already true
+        int ready = event == QUEUE_EV_NON_EMPTY ? q->count > 0 : q->count < q->max_count;
+        q->ev_armed[event] = 1;
+        if (ready)
+            fire = ev_fire(q, event);
+    }
+
+    int ret = q->ev_fd[event];
+    pthread_mutex_unlock(&q->lock);
+
+    if (fd >= 0)
+        close(fd);
+    ev_signal(fire);
+
+    return ret;
+}
+
 void queue_print_stats(queue_t *q) {
-	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+	long add_attempts = 0, get_attempts = 0, add_count = 0, get_count = 0, lock_ops = 0;
+	struct timespec now;
+
+	for (qstats_t *st = atomic_load(&q->stats); st; st = st->next) {
+		add_attempts += st->add_attempts;
+		get_attempts += st->get_attempts;
+		add_count += st->add_count;
+		get_count += st->get_count;
+		lock_ops += st->lock_ops;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = get_count;
+	q->last_ts = now;
+
+	long elems = add_count + get_count;
+
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); allocs %ld; lock ops/elem %.3f; eventfd writes %ld; %.0f ops/s\n",
 		q->count,
-		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
-		q->add_count, q->get_count, q->add_count -q->get_count);
+		add_attempts, get_attempts, add_attempts - get_attempts,
+		add_count, get_count, add_count - get_count,
+		q->allocs, elems ? (double)lock_ops / elems : 0.0, q->ev_writes, ops);
 }
-
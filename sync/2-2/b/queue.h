@@ -8,29 +8,88 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+// readiness events for queue_event_fd()
+enum {
+	QUEUE_EV_NON_EMPTY,
+	QUEUE_EV_NON_FULL,
+	QUEUE_EV_COUNT,
+};
 
 typedef struct _QueueNode {
 	int val;
 	struct _QueueNode *next;
 } qnode_t;
 
+// counters of one thread for one queue, written only by that thread
+typedef struct _QueueStats {
+    _Alignas(CACHE_LINE) long add_attempts;
+    long get_attempts;
+    long add_count;
+    long get_count;
+    long lock_ops;
+
+    pthread_t owner;
+    struct _QueueStats *next;
+} qstats_t;
+
 typedef struct _Queue {
+    // read-mostly after queue_init
+    qmon_entry_t *mon;
+    unsigned long id;
+    int max_count;
+
+    // preallocated slab of max_count nodes recycled through free_list
+    qnode_t *pool;
+
+    // per-thread counters, summed up by queue_print_stats
+    _Atomic(qstats_t *) stats;
+
+    // owned by queue_print_stats, used for the ops/sec rate
+    long last_get_count;
+    struct timespec last_ts;
+
+    // the lock and the state it protects: the lock holder touches only this
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
     qnode_t *first;
     qnode_t *last;
-    pthread_t qmonitor_tid;
     int count;
-    int max_count;
-    long add_attempts;
-    long get_attempts;
-    long add_count;
-    long get_count;
-    pthread_mutex_t lock; 
+    qnode_t *free_list;
+    long allocs;
+
+    // readiness eventfds (-1 until requested), see queue_event_fd()
+    int ev_fd[QUEUE_EV_COUNT];
+    int ev_armed[QUEUE_EV_COUNT];
+    long ev_writes;
 } queue_t;
 
 queue_t* queue_init(int max_count);
 void queue_destroy(queue_t *q);
 int queue_add(queue_t *q, int val);
 int queue_get(queue_t *q, int *val);
+// move up to n values under one lock round trip; return how many moved
+int queue_add_many(queue_t *q, const int *vals, int n);
+int queue_get_many(queue_t *q, int *vals, int n);
+
+/*
+ * Returns an eventfd (non-blocking) that becomes readable when the queue
+ * turns non-empty (QUEUE_EV_NON_EMPTY) or non-full (QUEUE_EV_NON_FULL),
+ * so queues can sit in an epoll set next to sockets. It is created on the
+ * first call and closed by queue_destroy.
+ * Edge-style: the fd is written once per edge, not per add. After it
+ * fires, read() it and then call queue_get (queue_add) until it returns
+ * 0; that failed call re-arms the event.
+ */
+int queue_event_fd(queue_t *q, int event);
 void queue_print_stats(queue_t *q);
 
 #endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,35 @@
+#!/bin/sh
+# usage: mkvariant.sh <name> <dir> <sources...>
+# Compiles a queue variant into <name>.o whose only global symbols are
+# <name>_queue_init/_destroy/_add/_get/_print_stats, so that every
+# variant can be linked into one queue-bench binary.
+
+set -e
+
+NAME=$1
+DIR=$2
+shift 2
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--g -Wall -O2}
+TMP=obj/${NAME}
+
+mkdir -p ${TMP}
+OBJS=
+for SRC in "$@"; do
+	OBJ=${TMP}/$(basename ${SRC} .c).o
+	${CC} ${CFLAGS} -I${DIR} -c ${DIR}/${SRC} -o ${OBJ}
+	OBJS="${OBJS} ${OBJ}"
+done
+
+ld -r ${OBJS} -o ${TMP}/all.o
+
+KEEP=
+RENAME=
+for SYM in queue_init queue_destroy queue_add queue_get queue_print_stats; do
+	KEEP="${KEEP} --keep-global-symbol=${SYM}"
+	RENAME="${RENAME} --redefine-sym ${SYM}=${NAME}_${SYM}"
+done
+
+objcopy ${KEEP} ${TMP}/all.o ${TMP}/local.o
+objcopy ${RENAME} ${TMP}/local.o ${NAME}.o
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * One benchmark for all queue variants.
+ * Each variant runs in a forked child for a fixed duration with N
+ * producers and M consumers. Its monitor output goes to /dev/null and
+ * threads stuck in a blocking queue die with the child. The child
+ * reports the counters through a pipe.
+ * "add ok"/"get ok" are the attempts that moved a value: a blocking
+ * variant waits on a full/empty queue instead of failing, so it is
+ * always at 100%, while a try variant counts every spin that found the
+ * queue full/empty. Compare those columns within a mode only.
+ */
+
+#define CACHE_LINE 64
+#define MAX_THREADS 256
+
+typedef struct _Variant {
+	const char *name;
+	void *(*init)(int max_count);
+	int (*add)(void *q, int val);
+	int (*get)(void *q, int *val);
+	int blocking;
+	int spsc;
+} variant_t;
+
+#define VARIANT(name, prefix, blocking, spsc) \
+	void *prefix##_queue_init(int max_count); \
+	int prefix##_queue_add(void *q, int val); \
+	int prefix##_queue_get(void *q, int *val);
+#include "variants.h"
+#undef VARIANT
+
+static variant_t variants[] = {
+#define VARIANT(name, prefix, blocking, spsc) \
+	{ name, prefix##_queue_init, prefix##_queue_add, prefix##_queue_get, blocking, spsc },
+#include "variants.h"
+#undef VARIANT
+};
+
+#define NR_VARIANTS (int)(sizeof(variants) / sizeof(variants[0]))
+
+typedef struct _Counter {
+	_Alignas(CACHE_LINE) _Atomic long attempts;
+	_Atomic long ops;
+} counter_t;
+
+typedef struct _Result {
+	long add_attempts;
+	long adds;
+	long get_attempts;
+	long gets;
+	double cpu;
+	double secs;
+} result_t;
+
+static int producers = 1, consumers = 1, capacity = 1000, duration = 3;
+static int producer_sleep;
+static int cpus[MAX_THREADS], nr_cpus;
+
+static atomic_int stop;
+static counter_t counters[MAX_THREADS];
+
+typedef struct _ThreadArg {
+	variant_t *v;
+	void *q;
+	int idx;
+} thread_arg_t;
+
+static void set_cpu(int idx) {
+	cpu_set_t cpuset;
+
+	if (!nr_cpus)
+		return;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpus[idx % nr_cpus], &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+}
+
+// single-writer counter, read by main at the deadline
+static inline void counter_inc(_Atomic long *c) {
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+		memory_order_relaxed);
+}
+
+void *writer(void *arg) {
+	thread_arg_t *a = (thread_arg_t *)arg;
+	counter_t *c = &counters[a->idx];
+	int i = 0;
+
+	set_cpu(a->idx);
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		if (producer_sleep)
+			usleep(producer_sleep);
+
+		counter_inc(&c->attempts);
+		if (!a->v->add(a->q, i))
+			continue;
+		counter_inc(&c->ops);
+		i++;
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	thread_arg_t *a = (thread_arg_t *)arg;
+	counter_t *c = &counters[a->idx];
+	int val;
+
+	set_cpu(a->idx);
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		counter_inc(&c->attempts);
+		if (a->v->get(a->q, &val))
+			counter_inc(&c->ops);
+	}
+
+	return NULL;
+}
+
+static double tv_secs(struct timeval tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void run_child(variant_t *v, int fd) {
+	static thread_arg_t args[MAX_THREADS];
+	pthread_t tid;
+	struct rusage ru;
+	struct timespec start, end;
+	result_t r;
+
+	void *q = v->init(capacity);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (int i = 0; i < producers + consumers; i++) {
+		args[i].v = v;
+		args[i].q = q;
+		args[i].idx = i;
+
+		int err = pthread_create(&tid, NULL, i < producers ? writer : reader, &args[i]);
+		if (err) {
+			fprintf(stderr, "queue-bench: pthread_create() failed: %s\n", strerror(err));
+			_exit(1);
+		}
+	}
+
+	sleep(duration);
+
+	// snapshot at the deadline, blocked threads may never see stop
+	atomic_store(&stop, 1);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &ru);
+
+	memset(&r, 0, sizeof(r));
+	for (int i = 0; i < producers + consumers; i++) {
+		long attempts = atomic_load(&counters[i].attempts);
+		long ops = atomic_load(&counters[i].ops);
+
+		if (i < producers) {
+			r.add_attempts += attempts;
+			r.adds += ops;
+		} else {
+			r.get_attempts += attempts;
+			r.gets += ops;
+		}
+	}
+	r.cpu = tv_secs(ru.ru_utime) + tv_secs(ru.ru_stime);
+	r.secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (write(fd, &r, sizeof(r)) != sizeof(r))
+		_exit(1);
+
+	_exit(0);
+}
+
+static const char *mode_name(variant_t *v) {
+	return v->blocking ? "block" : "try";
+}
+
+static int run_variant(variant_t *v) {
+	result_t r;
+	int fds[2];
+	int status;
+
+	if (v->spsc && (producers > 1 || consumers > 1)) {
+		printf("%-12s %-5s %3d %3d %8d   skipped: single producer/consumer only\n",
+			v->name, mode_name(v), producers, consumers, capacity);
+		return 0;
+	}
+
+	if (pipe(fds)) {
+		perror("pipe");
+		return -1;
+	}
+
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		int devnull = open("/dev/null", O_WRONLY);
+
+		close(fds[0]);
+		if (devnull >= 0)
+			dup2(devnull, STDOUT_FILENO);
+		run_child(v, fds[1]);
+	}
+
+	close(fds[1]);
+	ssize_t n = read(fds[0], &r, sizeof(r));
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+
+	if (n != sizeof(r)) {
+		printf("%-12s failed\n", v->name);
+		return -1;
+	}
+
+	printf("%-12s %-5s %3d %3d %8d %12.0f %12.0f %7.1f%% %7.1f%% %8.2f\n",
+		v->name, mode_name(v), producers, consumers, capacity,
+		r.adds / r.secs, r.gets / r.secs,
+		r.add_attempts ? 100.0 * r.adds / r.add_attempts : 0.0,
+		r.get_attempts ? 100.0 * r.gets / r.get_attempts : 0.0,
+		r.cpu);
+
+	return 0;
+}
+
+static int parse_cpus(char *list) {
+	for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+		if (nr_cpus == MAX_THREADS)
+			return -1;
+		cpus[nr_cpus++] = atoi(tok);
+	}
+
+	return nr_cpus ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+	printf("usage: %s [-p producers] [-c consumers] [-n capacity] [-t seconds]\n"
+		"       [-s producer usleep] [-C cpu,cpu,...] [variant ...]\n"
+		"threads are pinned round-robin over -C, producers first\n"
+		"variants:", prog);
+	for (int i = 0; i < NR_VARIANTS; i++)
+		printf(" %s", variants[i].name);
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	int opt, err = 0;
+
+	while ((opt = getopt(argc, argv, "p:c:n:t:s:C:h")) != -1) {
+		switch (opt) {
+		case 'p': producers = atoi(optarg); break;
+		case 'c': consumers = atoi(optarg); break;
+		case 'n': capacity = atoi(optarg); break;
+		case 't': duration = atoi(optarg); break;
+		case 's': producer_sleep = atoi(optarg); break;
+		case 'C':
+			if (parse_cpus(optarg)) {
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (producers < 1 || consumers < 1 || producers + consumers > MAX_THREADS
+			|| capacity < 1 || duration < 1 || producer_sleep < 0) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	printf("# mode block: waits when full/empty, so add/get ok stay at 100%%;\n"
+		"# mode try: fails and is retried, add/get ok is the share of attempts that moved a value\n");
+	printf("%-12s %-5s %3s %3s %8s %12s %12s %8s %8s %8s\n",
+		"variant", "mode", "P", "C", "capacity", "adds/s", "gets/s", "add ok", "get ok", "cpu s");
+
+	for (int i = 0; i < NR_VARIANTS; i++) {
+		int wanted = optind == argc;
+
+		for (int j = optind; j < argc; j++)
+			if (!strcmp(argv[j], variants[i].name))
+				wanted = 1;
+
+		if (wanted)
+			err |= run_variant(&variants[i]);
+	}
+
+	return err ? 1 : 0;
+}
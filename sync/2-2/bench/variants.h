@@ -0,0 +1,18 @@
+/*
+ * Every queue variant linked into queue-bench.
+ * VARIANT(name, symbol prefix, blocks when full/empty (the "mode" column), single producer/consumer only)
+ * The prefix must match the name passed to mkvariant.sh in the Makefile.
+ */
+VARIANT("a",          a,          0, 0)	// spinlock
+VARIANT("b",          b,          0, 0)	// mutex
+VARIANT("d",          d,          0, 0)	// mutex, run with -s for the sleeping writer
+VARIANT("f",          f,          1, 0)	// mutex + condvars
+VARIANT("g",          g,          1, 0)	// semaphores
+VARIANT("mpmc-ring",  mpmc_ring,  0, 0)
+VARIANT("spsc-ring",  spsc_ring,  0, 1)
+VARIANT("ms-queue",   ms_queue,   0, 0)
+VARIANT("two-lock",   two_lock,   0, 0)
+VARIANT("futex-park", futex_park, 1, 0)
+VARIANT("fc-queue",   fc_queue,   0, 0)	// flat combining
+VARIANT("seg-queue",  seg_queue,  0, 0)	// mutex, segments of values
+VARIANT("resize-ring", resize_ring, 0, 1)	// spsc, fixed at the queue_init size
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+/*
+ * One producer, n subscribers; the last one sleeps slow_us every
+ * SLOW_EVERY values, the producer adds in bursts of BURST. With gate
+ * the producer runs at the slow one's pace, with evict it drops it (the subscriber joins again and goes on from
+ * the tail). Prints the queue stats with the per-subscriber lag every
+ * second, then the rates; every subscriber checks it sees consecutive
+ * values between evictions.
+ * usage: queue-broadcast [gate|evict] [subscribers] [seconds] [ring_size] [slow_us]
+ */
+
+#define SLOW_EVERY 64
+// the producer yields after every burst, so the subscribers that are not
+// slow keep up even when they share its CPU
+#define BURST 256
+
+typedef struct _SubArg {
+	queue_t *q;
+	int id;
+	int slow_us;
+
+	long reads;
+	long rejoins;
+	long errors;
+} sub_arg_t;
+
+static _Atomic int stop;
+
+void *producer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	int i = 0;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		if (queue_add(q, i)) {
+			if (++i % BURST == 0)
+				sched_yield();
+		} else {
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+void *subscriber(void *arg) {
+	sub_arg_t *a = (sub_arg_t *)arg;
+	int expected = -1;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		int val;
+		int ret = queue_read(a->q, a->id, &val);
+
+		if (ret == QUEUE_EVICTED) {
+			queue_unsubscribe(a->q, a->id);
+			a->id = queue_subscribe(a->q);
+			a->rejoins++;
+			expected = -1;
+			continue;
+		}
+
+		if (!ret) {
+			sched_yield();
+			continue;
+		}
+
+		if (expected >= 0 && val != expected) {
+			if (!a->errors)
+				printf(RED"ERROR: subscriber %d got %d but expected %d" NOCOLOR "\n", a->id, val, expected);
+			a->errors++;
+		}
+		expected = val + 1;
+
+		if (++a->reads % SLOW_EVERY == 0 && a->slow_us)
+			usleep(a->slow_us);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	const char *mode = argc > 1 ? argv[1] : "gate";
+	int subs = 4, seconds = 3, size = 1024, slow_us = 100;
+	pthread_t tids[QUEUE_MAX_SUBSCRIBERS + 1];
+	sub_arg_t args[QUEUE_MAX_SUBSCRIBERS];
+	struct timespec start, end;
+	int err;
+
+	if (argc > 2)
+		subs = atoi(argv[2]);
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+	if (argc > 4)
+		size = atoi(argv[4]);
+	if (argc > 5)
+		slow_us = atoi(argv[5]);
+
+	int evict = !strcmp(mode, "evict");
+
+	if ((!evict && strcmp(mode, "gate")) || subs < 1 || subs > QUEUE_MAX_SUBSCRIBERS ||
+			seconds < 1 || size < 1 || slow_us < 0) {
+		printf("usage: %s [gate|evict] [subscribers] [seconds] [ring_size] [slow_us]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue_t *q = queue_init_broadcast(size, evict ? QUEUE_BCAST_EVICT : QUEUE_BCAST_GATE);
+
+	for (int i = 0; i < subs; i++) {
+		memset(&args[i], 0, sizeof(args[i]));
+		args[i].q = q;
+		args[i].id = queue_subscribe(q);
+		args[i].slow_us = i == subs - 1 ? slow_us : 0;
+
+		err = pthread_create(&tids[i], NULL, subscriber, &args[i]);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	err = pthread_create(&tids[subs], NULL, producer, q);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	for (int i = 0; i < seconds; i++) {
+		sleep(1);
+		queue_print_stats(q);
+	}
+
+	atomic_store(&stop, 1);
+	for (int i = 0; i <= subs; i++)
+		pthread_join(tids[i], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	long errors = 0;
+
+	printf("broadcast: %-5s subscribers %d size %d slow_us %d: %10.0f adds/s\n",
+		mode, subs, size, slow_us, atomic_load(&q->tail) / secs);
+	for (int i = 0; i < subs; i++) {
+		printf("  subscriber %2d%s: %10.0f reads/s, %ld rejoins%s\n",
+			i, args[i].slow_us ? " (slow)" : "", args[i].reads / secs, args[i].rejoins,
+			args[i].errors ? " ERROR" : "");
+		errors += args[i].errors;
+	}
+
+	queue_destroy(q);
+
+	return errors != 0;
+}
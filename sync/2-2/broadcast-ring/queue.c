@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+// single-writer counter: no RMW needed, the monitor only reads it
+static inline void stat_add(_Atomic long *c, long n) {
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+		memory_order_relaxed);
+}
+
+// the slowest active cursor, tail if nobody is subscribed
+static unsigned long gate(queue_t *q, unsigned long tail) {
+	unsigned long min = tail;
+
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++) {
+		qsub_t *s = &q->subs[i];
+
+		if (atomic_load_explicit(&s->state, memory_order_acquire) != QUEUE_SUB_ACTIVE)
+			continue;
+
+		unsigned long c = atomic_load_explicit(&s->cursor, memory_order_acquire);
+		if (c < min)
+			min = c;
+	}
+
+	return min;
+}
+
+// evicts everyone still at position pos, the slot about to be reused
+static void evict(queue_t *q, unsigned long pos) {
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++) {
+		qsub_t *s = &q->subs[i];
+		int active = QUEUE_SUB_ACTIVE;
+
+		if (atomic_load_explicit(&s->state, memory_order_relaxed) != QUEUE_SUB_ACTIVE ||
+				atomic_load_explicit(&s->cursor, memory_order_acquire) > pos)
+			continue;
+
+		if (atomic_compare_exchange_strong(&s->state, &active, QUEUE_SUB_EVICTED)) {
+			atomic_fetch_add_explicit(&s->evictions, 1, memory_order_relaxed);
+			stat_add(&q->evictions, 1);
+		}
+	}
+
+	// the marks before the slot stores, see queue_read()
+	atomic_thread_fence(memory_order_release);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+	unsigned long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	s->add_attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+	s->add_count = tail;
+	s->get_attempts = s->get_count = 0;
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++)
+		s->get_count += atomic_load_explicit(&q->subs[i].reads, memory_order_relaxed);
+	s->get_attempts = s->get_count;
+
+	// the backlog of the slowest subscriber
+	s->count = tail - gate(q, tail);
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = queue_init_broadcast(max_count, QUEUE_BCAST_GATE);
+
+	q->default_sub = queue_subscribe(q);
+
+	return q;
+}
+
+queue_t* queue_init_broadcast(int max_count, int policy) {
+	assert(max_count > 0);
+	assert(policy == QUEUE_BCAST_GATE || policy == QUEUE_BCAST_EVICT);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->size = round_up_pow2(max_count);
+	q->mask = q->size - 1;
+	q->policy = policy;
+	q->default_sub = -1;
+
+	q->slots = malloc(q->size * sizeof(*q->slots));
+	if (!q->slots) {
+		printf("Cannot allocate memory for queue slots\n");
+		abort();
+	}
+
+	atomic_store(&q->tail, 0);
+	q->gate_cache = 0;
+	atomic_store(&q->add_attempts, 0);
+	atomic_store(&q->evictions, 0);
+
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++) {
+		atomic_store(&q->subs[i].cursor, 0);
+		atomic_store(&q->subs[i].state, QUEUE_SUB_FREE);
+		atomic_store(&q->subs[i].reads, 0);
+		atomic_store(&q->subs[i].evictions, 0);
+	}
+
+	q->last_tail = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->slots);
+	free(q);
+}
+
+/*
+ * The producer may have computed its gate before we showed up: that
+ * gate is at most the tail it saw then, so starting at a tail read after
+ * going active is safe, and a cursor set before is only more conservative.
+ */
+int queue_subscribe(queue_t *q) {
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++) {
+		qsub_t *s = &q->subs[i];
+		int free_state = QUEUE_SUB_FREE;
+
+		if (!atomic_compare_exchange_strong(&s->state, &free_state, QUEUE_SUB_JOINING))
+			continue;
+
+		atomic_store(&s->cursor, atomic_load(&q->tail));
+		atomic_store(&s->state, QUEUE_SUB_ACTIVE);
+		atomic_store(&s->cursor, atomic_load(&q->tail));
+
+		return i;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+void queue_unsubscribe(queue_t *q, int id) {
+	assert(id >= 0 && id < QUEUE_MAX_SUBSCRIBERS);
+
+	atomic_store(&q->subs[id].state, QUEUE_SUB_FREE);
+}
+
+int queue_add(queue_t *q, int val) {
+	unsigned long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	stat_add(&q->add_attempts, 1);
+
+	if (tail - q->gate_cache >= q->size) {
+		q->gate_cache = gate(q, tail);
+
+		if (tail - q->gate_cache >= q->size) {
+			if (q->policy == QUEUE_BCAST_GATE)
+				return 0;
+
+			evict(q, tail - q->size);
+			q->gate_cache = gate(q, tail);
+		}
+	}
+
+	atomic_store_explicit(&q->slots[tail & q->mask], val, memory_order_relaxed);
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+	return 1;
+}
+
+int queue_read(queue_t *q, int id, int *val) {
+	qsub_t *s = &q->subs[id];
+	unsigned long c = atomic_load_explicit(&s->cursor, memory_order_relaxed);
+
+	if (atomic_load_explicit(&s->state, memory_order_relaxed) == QUEUE_SUB_EVICTED)
+		return QUEUE_EVICTED;
+
+	if (c == atomic_load_explicit(&q->tail, memory_order_acquire))
+		return 0;
+
+	int v = atomic_load_explicit(&q->slots[c & q->mask], memory_order_relaxed);
+
+	// if v is already from the next lap, the eviction mark is visible now
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&s->state, memory_order_relaxed) == QUEUE_SUB_EVICTED)
+		return QUEUE_EVICTED;
+
+	*val = v;
+	atomic_store_explicit(&s->cursor, c + 1, memory_order_release);
+	stat_add(&s->reads, 1);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	assert(q->default_sub >= 0);
+
+	return queue_read(q, q->default_sub, val) == 1;
+}
+
+unsigned long queue_lag(queue_t *q, int id) {
+	return atomic_load_explicit(&q->tail, memory_order_acquire) -
+		atomic_load_explicit(&q->subs[id].cursor, memory_order_acquire);
+}
+
+static const char *state_names[] = {
+	[QUEUE_SUB_FREE] = "free",
+	[QUEUE_SUB_JOINING] = "joining",
+	[QUEUE_SUB_ACTIVE] = "active",
+	[QUEUE_SUB_EVICTED] = "evicted",
+};
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+	unsigned long tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double adds = dt > 0 ? (tail - q->last_tail) / dt : 0;
+
+	q->last_tail = tail;
+	q->last_ts = now;
+
+	long attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+
+	printf("queue stats: %s ring of %lu; added %lu (failed %ld); evictions %ld; %.0f adds/s\n",
+		q->policy == QUEUE_BCAST_GATE ? "gated" : "evicting", q->size,
+		tail, attempts - (long)tail,
+		atomic_load_explicit(&q->evictions, memory_order_relaxed), adds);
+
+	for (int i = 0; i < QUEUE_MAX_SUBSCRIBERS; i++) {
+		qsub_t *s = &q->subs[i];
+		int state = atomic_load_explicit(&s->state, memory_order_relaxed);
+
+		if (state == QUEUE_SUB_FREE)
+			continue;
+
+		printf("  subscriber %2d: %-7s lag %8lu reads %10ld evictions %ld\n",
+			i, state_names[state], tail - atomic_load_explicit(&s->cursor, memory_order_relaxed),
+			atomic_load_explicit(&s->reads, memory_order_relaxed),
+			atomic_load_explicit(&s->evictions, memory_order_relaxed));
+	}
+}
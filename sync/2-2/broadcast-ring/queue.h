@@ -0,0 +1,99 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+#define QUEUE_MAX_SUBSCRIBERS 32
+
+// what the producer does when the slowest subscriber is a full ring behind
+enum {
+	QUEUE_BCAST_GATE,	// queue_add fails until it reads on
+	QUEUE_BCAST_EVICT,	// evict it, its queue_read returns QUEUE_EVICTED
+};
+
+enum {
+	QUEUE_SUB_FREE,
+	QUEUE_SUB_JOINING,
+	QUEUE_SUB_ACTIVE,
+	QUEUE_SUB_EVICTED,
+};
+
+#define QUEUE_EVICTED (-1)
+
+/*
+ * Single-producer broadcast ring: every subscriber sees every value.
+ * Values stay in the ring until the slowest subscriber read them; each
+ * subscriber only moves its own cursor (on its own cache line), the
+ * producer publishes tail and keeps a cached minimum of the cursors,
+ * rescanning them only when the cache says the ring is full.
+ *
+ * An evicted subscriber is told so by its next read, even if the
+ * producer overwrote the slot it was reading: the producer marks it
+ * evicted before reusing the slot and the reader checks the mark after
+ * loading the value.
+ * A new subscriber starts at the current tail (it only sees values added
+ * after it joined).
+ *
+ * queue_init() makes a gated ring with one subscriber that queue_get()
+ * reads through, so it works as a plain SPSC queue.
+ */
+typedef struct _QueueSubscriber {
+	_Alignas(CACHE_LINE) _Atomic unsigned long cursor;	// next position to read
+	_Atomic int state;
+	_Atomic long reads;
+	_Atomic long evictions;
+} qsub_t;
+
+typedef struct _Queue {
+	_Atomic int *slots;
+	unsigned long size;
+	unsigned long mask;
+	int policy;
+	int default_sub;
+
+	qmon_entry_t *mon;
+
+	// producer side
+	_Alignas(CACHE_LINE) _Atomic unsigned long tail;
+	unsigned long gate_cache;
+	_Atomic long add_attempts;
+	_Atomic long evictions;
+
+	qsub_t subs[QUEUE_MAX_SUBSCRIBERS];
+
+	// owned by queue_print_stats, used for the rate
+	_Alignas(CACHE_LINE) unsigned long last_tail;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+queue_t* queue_init_broadcast(int max_count, int policy);
+void queue_destroy(queue_t *q);
+
+// subscriber id, or -1 with errno EAGAIN if all QUEUE_MAX_SUBSCRIBERS are taken
+int queue_subscribe(queue_t *q);
+// also releases the id of an evicted subscriber
+void queue_unsubscribe(queue_t *q, int id);
+// 1 with a value, 0 if the subscriber is up to date, QUEUE_EVICTED
+int queue_read(queue_t *q, int id, int *val);
+// values added but not read by the subscriber yet
+unsigned long queue_lag(queue_t *q, int id);
+
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
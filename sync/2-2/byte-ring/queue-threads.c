@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "queue.h"
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+// message lengths are spread over [min_len, max_len]
+static size_t min_len = 8;
+static size_t max_len = 4096;
+
+void set_cpu(int n) {
+	int err;
+	cpu_set_t cpuset;
+	pthread_t tid = pthread_self();
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(n, &cpuset);
+
+	err = pthread_setaffinity_np(tid, sizeof(cpu_set_t), &cpuset);
+	if (err) {
+		printf("set_cpu: pthread_setaffinity failed for cpu %d\n", n);
+		return;
+	}
+
+	printf("set_cpu: set cpu %d\n", n);
+}
+
+// the writer and the reader derive the same length from the sequence number
+static size_t msg_len(unsigned int i) {
+	i ^= i << 13;
+	i ^= i >> 17;
+	i ^= i << 5;
+
+	return min_len + i % (max_len - min_len + 1);
+}
+
+void *reader(void *arg) {
+	int expected = 0;
+	queue_t *q = (queue_t *)arg;
+	printf("reader [%d %d %d]\n", getpid(), getppid(), gettid());
+
+	set_cpu(2);
+
+	while (1) {
+		size_t len;
+		const unsigned char *msg = queue_peek(q, &len);
+		if (!msg)
+			continue;
+
+		int val;
+		memcpy(&val, msg, sizeof(val));
+
+		if (expected != val)
+			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+		else if (len != msg_len(val) || msg[len - 1] != (val & 0xff))
+			printf(RED"ERROR: message %d has length %zu, expected %zu" NOCOLOR "\n", val, len, msg_len(val));
+
+		expected = val + 1;
+		queue_release(q);
+	}
+
+	return NULL;
+}
+
+void *writer(void *arg) {
+	int i = 0;
+	queue_t *q = (queue_t *)arg;
+	printf("writer [%d %d %d]\n", getpid(), getppid(), gettid());
+
+	set_cpu(1);
+
+	while (1) {
+		size_t len = msg_len(i);
+		unsigned char *msg = queue_reserve(q, len);
+		if (!msg)
+			continue;
+
+		memset(msg, i & 0xff, len);
+		memcpy(msg, &i, sizeof(i));
+		queue_commit(q);
+		i++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	pthread_t tid;
+	queue_t *q;
+	size_t capacity = 1 << 20;
+	int err;
+
+	if (argc > 1)
+		min_len = atol(argv[1]);
+	if (argc > 2)
+		max_len = atol(argv[2]);
+	if (argc > 3)
+		capacity = atol(argv[3]);
+
+	if (min_len < sizeof(int) || max_len < min_len || capacity < 4 * max_len) {
+		printf("usage: %s [min_len >= %zu] [max_len] [capacity >= 4 * max_len]\n", argv[0], sizeof(int));
+		return -1;
+	}
+
+	printf("main [%d %d %d]\n", getpid(), getppid(), gettid());
+
+	q = queue_init_bytes(capacity);
+
+	err = pthread_create(&tid, NULL, writer, q);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	//sched_yield();
+
+	err = pthread_create(&tid, NULL, reader, q);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	// TODO: join threads
+
+	pthread_exit(NULL);
+
+	return 0;
+}
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+static inline size_t rec_size(size_t len) {
+	return (sizeof(qrec_t) + len + QUEUE_REC_ALIGN - 1) & ~(size_t)(QUEUE_REC_ALIGN - 1);
+}
+
+// single-writer counter: no RMW needed, the monitor only reads it
+static inline void stat_add(_Atomic long *c, long n) {
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+		memory_order_relaxed);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->add_attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+	s->get_attempts = atomic_load_explicit(&q->get_attempts, memory_order_relaxed);
+	s->add_count = atomic_load_explicit(&q->add_count, memory_order_relaxed);
+	s->get_count = atomic_load_explicit(&q->get_count, memory_order_relaxed);
+	s->add_bytes = atomic_load_explicit(&q->add_bytes, memory_order_relaxed);
+	s->get_bytes = atomic_load_explicit(&q->get_bytes, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+// sized so that max_count int messages fit, as in the other variants
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	return queue_init_bytes(max_count * rec_size(sizeof(int)));
+}
+
+queue_t* queue_init_bytes(size_t capacity) {
+	assert(capacity >= 2 * rec_size(0));
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->size = round_up_pow2(capacity);
+	q->mask = q->size - 1;
+	q->max_msg = q->size / 2 - sizeof(qrec_t);
+
+	q->buf = aligned_alloc(CACHE_LINE, q->size < CACHE_LINE ? CACHE_LINE : q->size);
+	if (!q->buf) {
+		printf("Cannot allocate memory for queue buffer\n");
+		abort();
+	}
+
+	atomic_store(&q->tail, 0);
+	atomic_store(&q->head, 0);
+	q->head_cache = q->tail_cache = 0;
+	q->reserve_pos = q->reserve_len = 0;
+	q->peek_pos = q->peek_len = 0;
+
+	atomic_store(&q->add_attempts, 0);
+	atomic_store(&q->add_count, 0);
+	atomic_store(&q->add_bytes, 0);
+	atomic_store(&q->get_attempts, 0);
+	atomic_store(&q->get_count, 0);
+	atomic_store(&q->get_bytes, 0);
+
+	q->last_get_count = q->last_get_bytes = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->buf);
+	free(q);
+}
+
+// NULL with errno EAGAIN if the ring is full, EMSGSIZE if len > max_msg
+void *queue_reserve(queue_t *q, size_t len) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	size_t off = tail & q->mask;
+	size_t total = rec_size(len);
+
+	stat_add(&q->add_attempts, 1);
+
+	if (len > q->max_msg) {
+		errno = EMSGSIZE;
+		return NULL;
+	}
+
+	// the record must not straddle the end of the buffer
+	size_t pad = off + total > q->size ? q->size - off : 0;
+
+	if (tail + pad + total - q->head_cache > q->size) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail + pad + total - q->head_cache > q->size) {
+			errno = EAGAIN;
+			return NULL;
+		}
+	}
+
+	if (pad) {
+		((qrec_t *)(q->buf + off))->len = QUEUE_REC_PAD;
+		off = 0;
+	}
+
+	qrec_t *rec = (qrec_t *)(q->buf + off);
+	rec->len = len;
+
+	q->reserve_pos = tail + pad + total;
+	q->reserve_len = len;
+
+	return rec->data;
+}
+
+void queue_commit(queue_t *q) {
+	// publishes the pad record, if any, together with the message
+	atomic_store_explicit(&q->tail, q->reserve_pos, memory_order_release);
+
+	stat_add(&q->add_count, 1);
+	stat_add(&q->add_bytes, q->reserve_len);
+}
+
+const void *queue_peek(queue_t *q, size_t *len) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	stat_add(&q->get_attempts, 1);
+
+	if (head == q->tail_cache) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_cache)
+			return NULL;
+	}
+
+	qrec_t *rec = (qrec_t *)(q->buf + (head & q->mask));
+
+	// a pad is always committed together with the record after it
+	if (rec->len == QUEUE_REC_PAD) {
+		head += q->size - (head & q->mask);
+		rec = (qrec_t *)q->buf;
+	}
+
+	q->peek_pos = head + rec_size(rec->len);
+	q->peek_len = rec->len;
+
+	*len = rec->len;
+	return rec->data;
+}
+
+void queue_release(queue_t *q) {
+	atomic_store_explicit(&q->head, q->peek_pos, memory_order_release);
+
+	stat_add(&q->get_count, 1);
+	stat_add(&q->get_bytes, q->peek_len);
+}
+
+int queue_write(queue_t *q, const void *msg, size_t len) {
+	void *dst = queue_reserve(q, len);
+
+	if (!dst)
+		return 0;
+
+	memcpy(dst, msg, len);
+	queue_commit(q);
+
+	return 1;
+}
+
+// message length, 0 if the ring is empty, -1 with errno EMSGSIZE if the
+// message does not fit into buf (it stays in the ring)
+ssize_t queue_read(queue_t *q, void *buf, size_t buflen) {
+	size_t len;
+	const void *src = queue_peek(q, &len);
+
+	if (!src)
+		return 0;
+
+	if (len > buflen) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	memcpy(buf, src, len);
+	queue_release(q);
+
+	return len;
+}
+
+int queue_add(queue_t *q, int val) {
+	return queue_write(q, &val, sizeof(val));
+}
+
+int queue_get(queue_t *q, int *val) {
+	return queue_read(q, val, sizeof(*val)) == sizeof(*val);
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+	qmon_sample_t s;
+
+	queue_sample(q, &s);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double msgs = dt > 0 ? (s.get_count - q->last_get_count) / dt : 0;
+	double bytes = dt > 0 ? (s.get_bytes - q->last_get_bytes) / dt : 0;
+
+	q->last_get_count = s.get_count;
+	q->last_get_bytes = s.get_bytes;
+	q->last_ts = now;
+
+	printf("queue stats: current size %ld (%zu/%zu bytes); attempts: (%ld %ld %ld); counts (%ld %ld %ld); %.0f msgs/s %.1f MB/s\n",
+		s.count,
+		atomic_load_explicit(&q->tail, memory_order_relaxed) - atomic_load_explicit(&q->head, memory_order_relaxed),
+		q->size,
+		s.add_attempts, s.get_attempts, s.add_attempts - s.get_attempts,
+		s.add_count, s.get_count, s.add_count - s.get_count,
+		msgs, bytes / 1e6);
+}
@@ -0,0 +1,90 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+/*
+ * Single-producer/single-consumer byte ring of variable-length messages.
+ * Every record is a qrec_t header followed by the payload, padded to
+ * QUEUE_REC_ALIGN; records are stored back to back. A record that would
+ * straddle the end of the buffer is preceded by a pad record that fills
+ * the rest of it, so the payload is always contiguous.
+ * Capacity is counted in bytes; a message may take at most half of it,
+ * which guarantees that it fits after the pad once the ring drains.
+ *
+ *   producer: p = queue_reserve(q, len); fill p; queue_commit(q);
+ *   consumer: p = queue_peek(q, &len); use p; queue_release(q);
+ *
+ * queue_write/queue_read copy, queue_add/queue_get move a single int.
+ */
+#define QUEUE_REC_ALIGN 8
+#define QUEUE_REC_PAD UINT32_MAX
+
+typedef struct _QueueRecord {
+	uint32_t len;
+	uint32_t reserved;
+	unsigned char data[];
+} qrec_t;
+
+typedef struct _Queue {
+	unsigned char *buf;
+	size_t size;
+	size_t mask;
+	size_t max_msg;
+
+	qmon_entry_t *mon;
+
+	// written by the producer only; tail and head are byte offsets
+	_Alignas(CACHE_LINE) _Atomic size_t tail;
+	size_t head_cache;
+	size_t reserve_pos;
+	size_t reserve_len;
+	_Atomic long add_attempts;
+	_Atomic long add_count;
+	_Atomic long add_bytes;
+
+	// written by the consumer only
+	_Alignas(CACHE_LINE) _Atomic size_t head;
+	size_t tail_cache;
+	size_t peek_pos;
+	size_t peek_len;
+	_Atomic long get_attempts;
+	_Atomic long get_count;
+	_Atomic long get_bytes;
+
+	// owned by queue_print_stats, used for the rates
+	_Alignas(CACHE_LINE) long last_get_count;
+	long last_get_bytes;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+queue_t* queue_init_bytes(size_t capacity);
+void queue_destroy(queue_t *q);
+
+void *queue_reserve(queue_t *q, size_t len);
+void queue_commit(queue_t *q);
+const void *queue_peek(queue_t *q, size_t *len);
+void queue_release(queue_t *q);
+
+int queue_write(queue_t *q, const void *msg, size_t len);
+ssize_t queue_read(queue_t *q, void *buf, size_t buflen);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
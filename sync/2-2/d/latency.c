@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "latency.h"
+
+static _Atomic unsigned long lat_ids;
+
+// the last histogram set this thread recorded into
+static __thread unsigned long hist_stats_id;
+static __thread lat_hist_t *hist_slot;
+
+long lat_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int lat_bucket(long ns) {
+	if (ns < (1 << LAT_SUB_BITS))
+		return ns < 0 ? 0 : ns;
+
+	int msb = 63 - __builtin_clzl(ns);
+	int sub = (ns >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1);
+
+	return ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + sub;
+}
+
+// largest latency that falls into bucket b
+static long lat_bucket_max(int b) {
+	if (b < (1 << LAT_SUB_BITS))
+		return b;
+
+	int msb = (b >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+	int sub = b & ((1 << LAT_SUB_BITS) - 1);
+	long lower = ((1L << LAT_SUB_BITS) + sub) << (msb - LAT_SUB_BITS);
+
+	return lower + (1L << (msb - LAT_SUB_BITS)) - 1;
+}
+
+void lat_init(lat_stats_t *ls) {
+	atomic_store(&ls->hists, NULL);
+	ls->id = atomic_fetch_add(&lat_ids, 1) + 1;
+	memset(ls->prev, 0, sizeof(ls->prev));
+}
+
+void lat_destroy(lat_stats_t *ls) {
+	lat_hist_t *h = atomic_load(&ls->hists);
+
+	while (h) {
+		lat_hist_t *next = h->next;
+		free(h);
+		h = next;
+	}
+}
+
+static lat_hist_t *lat_hist(lat_stats_t *ls) {
+	if (hist_stats_id == ls->id)
+		return hist_slot;
+
+	pthread_t self = pthread_self();
+	lat_hist_t *h;
+
+	for (h = atomic_load(&ls->hists); h; h = h->next)
+		if (pthread_equal(h->owner, self))
+			break;
+
+	if (!h) {
+		h = aligned_alloc(64, sizeof(lat_hist_t));
+		if (!h) {
+			printf("Cannot allocate memory for latency histogram\n");
+			abort();
+		}
+		memset(h, 0, sizeof(lat_hist_t));
+		h->owner = self;
+
+		h->next = atomic_load(&ls->hists);
+		while (!atomic_compare_exchange_weak(&ls->hists, &h->next, h))
+			;
+	}
+
+	hist_stats_id = ls->id;
+	hist_slot = h;
+
+	return h;
+}
+
+void lat_record(lat_stats_t *ls, long ns) {
+	lat_hist_t *h = lat_hist(ls);
+	_Atomic long *b = &h->buckets[lat_bucket(ns)];
+
+	// single writer per histogram: no RMW needed
+	atomic_store_explicit(b, atomic_load_explicit(b, memory_order_relaxed) + 1,
+		memory_order_relaxed);
+
+	// max is reset by the monitor, so it needs a CAS
+	long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, ns,
+			memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+// the bucket upper bound, but never above the exact max of the interval;
+// max is 0 if the only samples raced with its reset, keep the bound then
+static long lat_percentile(const long *interval, long total, double p, long max) {
+	long rank = (long)(total * p);
+	long seen = 0;
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS - 1; b++) {
+		seen += interval[b];
+		if (seen > rank)
+			break;
+	}
+
+	long ns = lat_bucket_max(b);
+	return max && ns > max ? max : ns;
+}
+
+void lat_interval(lat_stats_t *ls, lat_summary_t *sum) {
+	long interval[LAT_BUCKETS];
+	long total = 0, max = 0;
+
+	memset(interval, 0, sizeof(interval));
+
+	for (lat_hist_t *h = atomic_load(&ls->hists); h; h = h->next) {
+		for (int b = 0; b < LAT_BUCKETS; b++)
+			interval[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+
+		long m = atomic_exchange_explicit(&h->max, 0, memory_order_relaxed);
+		if (m > max)
+			max = m;
+	}
+
+	for (int b = 0; b < LAT_BUCKETS; b++) {
+		long cur = interval[b];
+
+		interval[b] -= ls->prev[b];
+		ls->prev[b] = cur;
+		total += interval[b];
+	}
+
+	memset(sum, 0, sizeof(*sum));
+	sum->n = total;
+	if (!total)
+		return;
+
+	sum->p50_ns = lat_percentile(interval, total, 0.50, max);
+	sum->p99_ns = lat_percentile(interval, total, 0.99, max);
+	sum->p999_ns = lat_percentile(interval, total, 0.999, max);
+	sum->max_ns = max;
+}
@@ -0,0 +1,48 @@
+#ifndef __FITOS_LATENCY_H__
+#define __FITOS_LATENCY_H__
+
+#include <stdatomic.h>
+
+/*
+ * Log-bucketed enqueue->dequeue latency histograms (QUEUE_LATENCY mode).
+ * Every consumer thread records into its own histogram without locks;
+ * lat_interval() sums them and reports percentiles for the values
+ * recorded since its previous call.
+ * Buckets: 2^LAT_SUB_BITS sub-buckets per power of two nanoseconds.
+ */
+
+#define LAT_SUB_BITS 2
+#define LAT_BUCKETS (64 << LAT_SUB_BITS)
+
+typedef struct _LatHist {
+	_Alignas(64) _Atomic long buckets[LAT_BUCKETS];
+	_Atomic long max;
+
+	pthread_t owner;
+	struct _LatHist *next;
+} lat_hist_t;
+
+typedef struct _LatStats {
+	_Atomic(lat_hist_t *) hists;
+	unsigned long id;
+
+	// owned by lat_interval
+	long prev[LAT_BUCKETS];
+} lat_stats_t;
+
+// latencies in ns, bucket upper bounds capped at max, max exact
+typedef struct _LatSummary {
+	long n;
+	long p50_ns;
+	long p99_ns;
+	long p999_ns;
+	long max_ns;
+} lat_summary_t;
+
+long lat_now(void);
+void lat_init(lat_stats_t *ls);
+void lat_destroy(lat_stats_t *ls);
+void lat_record(lat_stats_t *ls, long ns);
+void lat_interval(lat_stats_t *ls, lat_summary_t *sum);
+
+#endif		// __FITOS_LATENCY_H__
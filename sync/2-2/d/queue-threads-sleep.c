@@ -7,12 +7,23 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sched.h>
+#include <time.h>
 
 #include "queue.h"
 
 #define RED "\033[41m"
 #define NOCOLOR "\033[0m"
 
+/*
+ * usage: queue-threads-sleep [reject|drop-newest|drop-oldest] [max_count] [reader_delay_us]
+ * With a drop policy and a reader slower than the writer, values go
+ * missing on purpose: the reader reports the gaps (once a second) and
+ * only values going backwards are errors.
+ */
+static int policy = QUEUE_FULL_REJECT;
+static int max_count = 1000000;
+static int reader_delay_us = 0;
+
 void set_cpu(int n) {
 	int err;
 	cpu_set_t cpuset;
@@ -32,6 +43,8 @@ void set_cpu(int n) {
 
 void *reader(void *arg) {
 	int expected = 0;
+	long gaps = 0, lost = 0, reported = 0;
+	time_t last_report = time(NULL);
 	queue_t *q = (queue_t *)arg;
 	printf("reader [%d %d %d]\n", getpid(), getppid(), gettid());
 
@@ -43,10 +56,23 @@ void *reader(void *arg) {
 		if (!ok)
 			continue;
 
-		if (expected != val)
+		if (val < expected)
 			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+		else if (val > expected) {
+			gaps++;
+			lost += val - expected;
+		}
 
 		expected = val + 1;
+
+		if (gaps != reported && time(NULL) != last_report) {
+			printf("reader: %ld gaps, %ld values lost so far\n", gaps, lost);
+			reported = gaps;
+			last_report = time(NULL);
+		}
+
+		if (reader_delay_us)
+			usleep(reader_delay_us);
 	}
 
 	return NULL;
@@ -70,14 +96,30 @@ void *writer(void *arg) {
 	return NULL;
 }
 
-int main() {
+int main(int argc, char **argv) {
 	pthread_t tid;
 	queue_t *q;
 	int err;
 
+	if (argc > 1) {
+		for (policy = QUEUE_FULL_DROP_OLDEST; policy > QUEUE_FULL_REJECT; policy--)
+			if (!strcmp(argv[1], queue_policy_name(policy)))
+				break;
+	}
+	if (argc > 2)
+		max_count = atoi(argv[2]);
+	if (argc > 3)
+		reader_delay_us = atoi(argv[3]);
+
+	if ((argc > 1 && strcmp(argv[1], queue_policy_name(policy))) || max_count < 1 || reader_delay_us < 0) {
+		printf("usage: %s [reject|drop-newest|drop-oldest] [max_count] [reader_delay_us]\n", argv[0]);
+		return -1;
+	}
+
 	printf("main [%d %d %d]\n", getpid(), getppid(), gettid());
 
-	q = queue_init(1000000);
+	q = queue_init(max_count);
+	queue_set_policy(q, policy);
 
 	err = pthread_create(&tid, NULL, reader, q);
 	if (err) {
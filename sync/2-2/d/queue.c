@@ -4,22 +4,84 @@
 
 #include "queue.h"
 
-void *qmonitor(void *arg) {
-	queue_t *q = (queue_t *)arg;
+static void pool_init(queue_t *q) {
+	q->pool = malloc(q->max_count * sizeof(qnode_t));
+	if (!q->pool) {
+		printf("Cannot allocate memory for node pool\n");
+		abort();
+	}
+
+	q->free_list = NULL;
+	for (int i = q->max_count - 1; i >= 0; i--) {
+		q->pool[i].next = q->free_list;
+		q->free_list = &q->pool[i];
+	}
+
+	q->allocs = 0;
+}
+
+// callers hold the queue lock
+static qnode_t *node_alloc(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	if (n) {
+		q->free_list = n->next;
+		return n;
+	}
 
-	printf("qmonitor: [%d %d %d]\n", getpid(), getppid(), gettid());
+	n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	q->allocs++;
+
+	return n;
+}
+
+static void node_free(queue_t *q, qnode_t *n) {
+	n->next = q->free_list;
+	q->free_list = n;
+}
+
+static void pool_destroy(queue_t *q) {
+	qnode_t *n = q->free_list;
 
-	while (1) {
-		queue_print_stats(q);
-		sleep(1);
+	while (n) {
+		qnode_t *next = n->next;
+		if (n < q->pool || n >= q->pool + q->max_count)
+			free(n);
+		n = next;
 	}
 
-	return NULL;
+	free(q->pool);
 }
 
-queue_t* queue_init(int max_count) {
-	int err;
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+	s->drops = q->drops_newest + q->drops_oldest;
+	s->allocs = q->allocs;
+
+#ifdef QUEUE_LATENCY
+	lat_summary_t lat;
+
+	lat_interval(&q->lat, &lat);
+	s->lat_n = lat.n;
+	s->lat_p50_ns = lat.p50_ns;
+	s->lat_p99_ns = lat.p99_ns;
+	s->lat_p999_ns = lat.p999_ns;
+	s->lat_max_ns = lat.max_ns;
+#endif
+}
 
+queue_t* queue_init(int max_count) {
 	queue_t *q = malloc(sizeof(queue_t));
 	if (!q) {
 		printf("Cannot allocate memory for a queue\n");
@@ -34,41 +96,75 @@ queue_t* queue_init(int max_count) {
 	q->add_attempts = q->get_attempts = 0;
 	q->add_count = q->get_count = 0;
 
-	err = pthread_create(&q->qmonitor_tid, NULL, qmonitor, q);
-	if (err) {
-		printf("queue_init: pthread_create() failed: %s\n", strerror(err));
-		abort();
-	}
+	q->policy = QUEUE_FULL_REJECT;
+	q->drops_newest = q->drops_oldest = 0;
+
+	pool_init(q);
+
+	pthread_mutex_init(&q->lock, NULL);
+
+#ifdef QUEUE_LATENCY
+	lat_init(&q->lat);
+#endif
+
+	q->mon = qmon_register(q, queue_sample);
 
 	return q;
 }
 
 void queue_destroy(queue_t *q) {
+    qmon_unregister(q->mon);
+
     qnode_t *current = q->first;
     while (current != NULL) {
         qnode_t *temp = current;
         current = current->next;
-        free(temp);
+        node_free(q, temp);
     }
+    pool_destroy(q);
+    pthread_mutex_destroy(&q->lock);
+#ifdef QUEUE_LATENCY
+    lat_destroy(&q->lat);
+#endif
     free(q);
 }
 
 int queue_add(queue_t *q, int val) {
+#ifdef QUEUE_LATENCY
+    long stamp = lat_now();
+#endif
+
     pthread_mutex_lock(&q->lock);
 
     q->add_attempts++;
     if (q->count == q->max_count) {
-        pthread_mutex_unlock(&q->lock);
-        return 0;
+        if (q->policy == QUEUE_FULL_REJECT) {
+            pthread_mutex_unlock(&q->lock);
+            return 0;
+        }
+
+        if (q->policy == QUEUE_FULL_DROP_NEWEST) {
+            q->drops_newest++;
+            pthread_mutex_unlock(&q->lock);
+            return 1;
+        }
+
+        // DROP_OLDEST: unlink the head, its node is reused right below
+        qnode_t *old = q->first;
+        q->first = old->next;
+        if (!q->first)
+            q->last = NULL;
+        node_free(q, old);
+        q->count--;
+        q->drops_oldest++;
     }
 
-    qnode_t *new = malloc(sizeof(qnode_t));
-    if (!new) {
-        printf("Cannot allocate memory for new node\n");
-        abort();
-    }
+    qnode_t *new = node_alloc(q);
     new->val = val;
     new->next = NULL;
+#ifdef QUEUE_LATENCY
+    new->stamp = stamp;
+#endif
 
     if (!q->first)
         q->first = q->last = new;
@@ -95,19 +191,45 @@ int queue_get(queue_t *q, int *val) {
 
     qnode_t *tmp = q->first;
     *val = tmp->val;
+#ifdef QUEUE_LATENCY
+    long stamp = tmp->stamp;
+#endif
     q->first = q->first->next;
-    free(tmp);
+    node_free(q, tmp);
     q->count--;
     q->get_count++;
 
     pthread_mutex_unlock(&q->lock);
+
+#ifdef QUEUE_LATENCY
+    lat_record(&q->lat, lat_now() - stamp);
+#endif
     return 1;
 }
 
+static const char *policy_names[] = {
+	[QUEUE_FULL_REJECT] = "reject",
+	[QUEUE_FULL_DROP_NEWEST] = "drop-newest",
+	[QUEUE_FULL_DROP_OLDEST] = "drop-oldest",
+};
+
+void queue_set_policy(queue_t *q, int policy) {
+	assert(policy >= QUEUE_FULL_REJECT && policy <= QUEUE_FULL_DROP_OLDEST);
+
+	pthread_mutex_lock(&q->lock);
+	q->policy = policy;
+	pthread_mutex_unlock(&q->lock);
+}
+
+const char *queue_policy_name(int policy) {
+	return policy >= QUEUE_FULL_REJECT && policy <= QUEUE_FULL_DROP_OLDEST ? policy_names[policy] : "?";
+}
+
 void queue_print_stats(queue_t *q) {
-	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); allocs %ld; policy %s drops: newest %ld oldest %ld\n",
 		q->count,
 		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
-		q->add_count, q->get_count, q->add_count -q->get_count);
+		q->add_count, q->get_count, q->add_count -q->get_count,
+		q->allocs, queue_policy_name(q->policy), q->drops_newest, q->drops_oldest);
 }
 
@@ -8,16 +8,46 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
+
+#include "qmon.h"
+
+#ifdef QUEUE_LATENCY
+#include "latency.h"
+#endif
+
+/*
+ * What queue_add does on a full queue, see queue_set_policy():
+ *   REJECT       fail, the caller retries (the default)
+ *   DROP_NEWEST  discard the new value and report success
+ *   DROP_OLDEST  discard the oldest queued value to make room, so the
+ *                queue keeps the latest max_count values (ring overwrite)
+ * The two drop policies never fail an add; dropped values are counted.
+ */
+enum {
+	QUEUE_FULL_REJECT,
+	QUEUE_FULL_DROP_NEWEST,
+	QUEUE_FULL_DROP_OLDEST,
+};
 
 typedef struct _QueueNode {
 	int val;
 	struct _QueueNode *next;
+#ifdef QUEUE_LATENCY
+	long stamp;	// enqueue time, CLOCK_MONOTONIC ns
+#endif
 } qnode_t;
 
 typedef struct _Queue {
     qnode_t *first;
     qnode_t *last;
-    pthread_t qmonitor_tid;
+    qmon_entry_t *mon;
+
+    // preallocated slab of max_count nodes recycled through free_list
+    qnode_t *pool;
+    qnode_t *free_list;
+    long allocs;
+
     int count;
     int max_count;
     long add_attempts;
@@ -25,12 +55,22 @@ typedef struct _Queue {
     long add_count;
     long get_count;
     pthread_mutex_t lock; 
+
+    int policy;
+    long drops_newest;
+    long drops_oldest;
+
+#ifdef QUEUE_LATENCY
+    lat_stats_t lat;
+#endif
 } queue_t;
 
 queue_t* queue_init(int max_count);
 void queue_destroy(queue_t *q);
 int queue_add(queue_t *q, int val);
 int queue_get(queue_t *q, int *val);
+void queue_set_policy(queue_t *q, int policy);
+const char *queue_policy_name(int policy);
 void queue_print_stats(queue_t *q);
 
 #endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+/*
+ * Lost wakeup check for the coalescing. Every round parks n consumers
+ * on an empty queue and then adds n values one by one; every consumer
+ * has to get one. Then it fills the queue, parks n producers on it and
+ * gets n values one by one; every producer has to add its value. A
+ * thread still asleep a second later is a lost wakeup.
+ * usage: queue-drain [rounds] [threads] [get_batch] [add_batch] [max_count]
+ */
+
+#define DRAIN_TIMEOUT_S 1
+
+static queue_t *queue;
+
+void *reader(void *arg) {
+	int val;
+
+	queue_get(queue, &val);
+	return NULL;
+}
+
+void *writer(void *arg) {
+	queue_add(queue, 1);
+	return NULL;
+}
+
+static void wait_parked(int *waiters, int n) {
+	while (1) {
+		pthread_mutex_lock(&queue->mutex);
+		int parked = *waiters;
+		pthread_mutex_unlock(&queue->mutex);
+
+		if (parked == n)
+			return;
+		usleep(100);
+	}
+}
+
+static int join_all(pthread_t *tids, int n, const char *what, int round) {
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += DRAIN_TIMEOUT_S;
+
+	for (int i = 0; i < n; i++) {
+		if (pthread_timedjoin_np(tids[i], NULL, &deadline)) {
+			printf(RED"ERROR: round %d: %s still asleep, count %d get_waiters %d add_waiters %d" NOCOLOR "\n",
+				round, what, queue->count, queue->get_waiters, queue->add_waiters);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int rounds = 1000, threads = 4, max_count = 64;
+	int get_batch = QUEUE_WAKE_BATCH, add_batch = QUEUE_WAKE_BATCH;
+	pthread_t tids[64];
+	int val, err;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		threads = atoi(argv[2]);
+	if (argc > 3)
+		get_batch = atoi(argv[3]);
+	if (argc > 4)
+		add_batch = atoi(argv[4]);
+	if (argc > 5)
+		max_count = atoi(argv[5]);
+
+	if (rounds < 1 || threads < 1 || threads > 64 || max_count < threads) {
+		printf("usage: %s [rounds] [threads] [get_batch] [add_batch] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	queue = queue_init(max_count);
+	queue_set_wake_batch(queue, get_batch, add_batch);
+
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < threads; i++) {
+			err = pthread_create(&tids[i], NULL, reader, NULL);
+			if (err) {
+				printf("main: pthread_create() failed: %s\n", strerror(err));
+				return -1;
+			}
+		}
+		wait_parked(&queue->get_waiters, threads);
+
+		for (int i = 0; i < threads; i++)
+			queue_add(queue, i);
+		if (join_all(tids, threads, "consumer", r))
+			return 1;
+
+		for (int i = 0; i < max_count; i++)
+			queue_add(queue, i);
+
+		for (int i = 0; i < threads; i++) {
+			err = pthread_create(&tids[i], NULL, writer, NULL);
+			if (err) {
+				printf("main: pthread_create() failed: %s\n", strerror(err));
+				return -1;
+			}
+		}
+		wait_parked(&queue->add_waiters, threads);
+
+		for (int i = 0; i < threads; i++)
+			queue_get(queue, &val);
+		if (join_all(tids, threads, "producer", r))
+			return 1;
+
+		for (int i = 0; i < max_count; i++)
+			queue_get(queue, &val);
+	}
+
+	printf("drain: %d rounds of %d parked consumers and producers, get_batch %d add_batch %d: ok; wakeups %ld\n",
+		rounds, threads, queue->get_wake_batch, queue->add_wake_batch, queue->wakeups);
+
+	queue_destroy(queue);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Accuracy and cost of queue_add_timed/queue_get_timed.
+ * accuracy: waiters threads time out on an empty queue over and over;
+ *   reports how late they come back after the deadline (and any early
+ *   return, which would be a bug).
+ * overhead: producers/consumers move ops values with queue_add/queue_get
+ *   and then with the timed calls and a far deadline.
+ * Also linked against 2-2/g.
+ * usage: queue-timeout [waiters] [timeout_us] [rounds] [producers] [consumers] [ops]
+ */
+
+#ifndef VARIANT
+#define VARIANT "queue"
+#endif
+
+static int waiters = 4, rounds = 200, producers = 2, consumers = 2;
+static long timeout_us = 1000, ops = 200000;
+
+static queue_t *queue;
+static long *overshoot;
+static long early;
+static pthread_mutex_t early_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static struct timespec deadline_in(long ns) {
+	long t = now_ns() + ns;
+
+	return (struct timespec){ .tv_sec = t / 1000000000L, .tv_nsec = t % 1000000000L };
+}
+
+void *waiter(void *arg) {
+	long id = (long)arg;
+
+	for (int r = 0; r < rounds; r++) {
+		struct timespec deadline = deadline_in(timeout_us * 1000);
+		long deadline_ns = deadline.tv_sec * 1000000000L + deadline.tv_nsec;
+		int val;
+
+		int err = queue_get_timed(queue, &val, &deadline);
+		long late = now_ns() - deadline_ns;
+
+		if (err != ETIMEDOUT || late < 0) {
+			pthread_mutex_lock(&early_lock);
+			early++;
+			pthread_mutex_unlock(&early_lock);
+		}
+		overshoot[id * rounds + r] = late;
+	}
+
+	return NULL;
+}
+
+static int cmp_long(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run_accuracy(void) {
+	pthread_t tids[waiters];
+	long n = (long)waiters * rounds;
+
+	queue = queue_init(16);
+	overshoot = malloc(n * sizeof(long));
+	if (!overshoot) {
+		printf("Cannot allocate memory for results\n");
+		abort();
+	}
+
+	for (long i = 0; i < waiters; i++)
+		pthread_create(&tids[i], NULL, waiter, (void *)i);
+	for (int i = 0; i < waiters; i++)
+		pthread_join(tids[i], NULL);
+
+	qsort(overshoot, n, sizeof(long), cmp_long);
+
+	printf("timeout: %-6s waiters %2d timeout %6ldus: n %ld early %ld late p50 %.1fus p99 %.1fus max %.1fus\n",
+		VARIANT, waiters, timeout_us, n, early,
+		overshoot[n / 2] / 1e3, overshoot[n * 99 / 100] / 1e3, overshoot[n - 1] / 1e3);
+
+	free(overshoot);
+}
+
+static int timed;
+
+void *writer(void *arg) {
+	long id = (long)arg;
+
+	for (long v = id; v < ops; v += producers) {
+		if (timed) {
+			struct timespec deadline = deadline_in(10000000000L);
+			queue_add_timed(queue, v, &deadline);
+		} else {
+			queue_add(queue, v);
+		}
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	long count = (long)arg;
+	int v;
+
+	for (long i = 0; i < count; i++) {
+		if (timed) {
+			struct timespec deadline = deadline_in(10000000000L);
+			queue_get_timed(queue, &v, &deadline);
+		} else {
+			queue_get(queue, &v);
+		}
+	}
+
+	return NULL;
+}
+
+static void run_overhead(int use_timed) {
+	pthread_t tids[producers + consumers];
+
+	timed = use_timed;
+	queue = queue_init(1024);
+
+	long start = now_ns();
+
+	for (long i = 0; i < producers; i++)
+		pthread_create(&tids[i], NULL, writer, (void *)i);
+	for (int i = 0; i < consumers; i++) {
+		// the first consumers take the remainder
+		long count = ops / consumers + (i < ops % consumers);
+		pthread_create(&tids[producers + i], NULL, reader, (void *)count);
+	}
+	for (int i = 0; i < producers + consumers; i++)
+		pthread_join(tids[i], NULL);
+
+	double secs = (now_ns() - start) / 1e9;
+
+	printf("overhead: %-6s %-7s producers %2d consumers %2d: %12.0f ops/s\n",
+		VARIANT, use_timed ? "timed" : "untimed", producers, consumers, ops / secs);
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1)
+		waiters = atoi(argv[1]);
+	if (argc > 2)
+		timeout_us = atol(argv[2]);
+	if (argc > 3)
+		rounds = atoi(argv[3]);
+	if (argc > 4)
+		producers = atoi(argv[4]);
+	if (argc > 5)
+		consumers = atoi(argv[5]);
+	if (argc > 6)
+		ops = atol(argv[6]);
+
+	if (waiters < 1 || timeout_us < 0 || rounds < 1 || producers < 1 || consumers < 1 || ops < 1) {
+		printf("usage: %s [waiters] [timeout_us] [rounds] [producers] [consumers] [ops]\n", argv[0]);
+		return -1;
+	}
+
+	run_accuracy();
+	run_overhead(0);
+	run_overhead(1);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Latency vs throughput of the wakeup thresholds.
+ * Producers stamp every value when adding it, consumers compute the
+ * enqueue->dequeue latency; values are indices into the stamp array.
+ * usage: queue-wakeup [get_batch] [add_batch] [producers] [consumers] [ops] [max_count]
+ */
+
+static int producers = 1, consumers = 4;
+static long ops = 1000000;
+
+static queue_t *queue;
+static long *stamps;
+static long *latency;
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void *writer(void *arg) {
+	long id = (long)arg;
+
+	for (long v = id; v < ops; v += producers) {
+		stamps[v] = now_ns();
+		queue_add(queue, v);
+	}
+
+	return NULL;
+}
+
+typedef struct _ReaderArg {
+	queue_t *q;
+	long count;
+} reader_arg_t;
+
+void *reader(void *arg) {
+	reader_arg_t *a = (reader_arg_t *)arg;
+
+	for (long i = 0; i < a->count; i++) {
+		int v;
+
+		queue_get(a->q, &v);
+		latency[v] = now_ns() - stamps[v];
+	}
+
+	return NULL;
+}
+
+static int cmp_long(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+	int get_batch = QUEUE_WAKE_BATCH, add_batch = QUEUE_WAKE_BATCH, max_count = 1024;
+	pthread_t tids[128];
+	reader_arg_t rargs[64];
+	int err;
+
+	if (argc > 1)
+		get_batch = atoi(argv[1]);
+	if (argc > 2)
+		add_batch = atoi(argv[2]);
+	if (argc > 3)
+		producers = atoi(argv[3]);
+	if (argc > 4)
+		consumers = atoi(argv[4]);
+	if (argc > 5)
+		ops = atol(argv[5]);
+	if (argc > 6)
+		max_count = atoi(argv[6]);
+
+	if (producers < 1 || producers > 64 || consumers < 1 || consumers > 64
+			|| ops < consumers || ops > 0x7fffffff || max_count < 1) {
+		printf("usage: %s [get_batch] [add_batch] [producers] [consumers] [ops] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	queue_t *q = queue_init(max_count);
+	queue_set_wake_batch(q, get_batch, add_batch);
+
+	queue = q;
+	stamps = malloc(ops * sizeof(long));
+	latency = malloc(ops * sizeof(long));
+	if (!stamps || !latency) {
+		printf("main: cannot allocate memory\n");
+		return -1;
+	}
+
+	long start = now_ns();
+
+	for (int i = 0; i < consumers; i++) {
+		rargs[i].q = q;
+		rargs[i].count = ops / consumers + (i < ops % consumers);
+		err = pthread_create(&tids[i], NULL, reader, &rargs[i]);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	for (long i = 0; i < producers; i++) {
+		err = pthread_create(&tids[consumers + i], NULL, writer, (void *)i);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < consumers + producers; i++)
+		pthread_join(tids[i], NULL);
+
+	double secs = (now_ns() - start) / 1e9;
+
+	qsort(latency, ops, sizeof(long), cmp_long);
+
+	printf("wakeup: get_batch %4d add_batch %4d: %10.0f ops/s; latency us p50 %8.1f p99 %8.1f max %8.1f; wakeups %ld\n",
+		q->get_wake_batch, q->add_wake_batch, ops / secs,
+		latency[ops / 2] / 1e3, latency[ops * 99 / 100] / 1e3, latency[ops - 1] / 1e3,
+		q->wakeups);
+
+	queue_destroy(q);
+	free(stamps);
+	free(latency);
+
+	return 0;
+}
@@ -4,20 +4,183 @@
 
 #include "queue.h"
 
-void *qmonitor(void *arg) {
-	queue_t *q = (queue_t *)arg;
-	printf("qmonitor: [%d %d %d]\n", getpid(), getppid(), gettid());
+static void pool_init(queue_t *q) {
+	q->pool = malloc(q->max_count * sizeof(qnode_t));
+	if (!q->pool) {
+		printf("Cannot allocate memory for node pool\n");
+		abort();
+	}
 
-	while (1) {
-		queue_print_stats(q);
-		sleep(1);
+	q->free_list = NULL;
+	for (int i = q->max_count - 1; i >= 0; i--) {
+		q->pool[i].next = q->free_list;
+		q->free_list = &q->pool[i];
 	}
-	return NULL;
+
+	q->allocs = 0;
 }
 
-queue_t* queue_init(int max_count) {
-	int err;
+// callers hold the queue lock
+static qnode_t *node_alloc(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	if (n) {
+		q->free_list = n->next;
+		return n;
+	}
+
+	n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	q->allocs++;
+
+	return n;
+}
+
+static void node_free(queue_t *q, qnode_t *n) {
+	n->next = q->free_list;
+	q->free_list = n;
+}
+
+static void pool_destroy(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	while (n) {
+		qnode_t *next = n->next;
+		if (n < q->pool || n >= q->pool + q->max_count)
+			free(n);
+		n = next;
+	}
+
+	free(q->pool);
+}
+
+/*
+ * Wakeup coalescing, called with q->mutex held.
+ * Consumers only sleep on an empty queue, so one is woken when it
+ * becomes non-empty, and all of them every get_wake_batch added values
+ * while some are still asleep. Producers only sleep on a full queue:
+ * one is woken by the first slot freed, all of them every
+ * add_wake_batch freed slots or when it drains. Adds to a non-empty
+ * queue (gets from a non-full one) skip the signal, so whoever was
+ * woken passes it on: a consumer that slept and leaves values behind
+ * while others still sleep wakes the next one, and likewise producers.
+ * Nobody waiting means no signal at all.
+ */
+static void wake_consumers(queue_t *q, int prev_count, int added) {
+    q->added_since_wake += added;
+
+    if (!q->get_waiters)
+        return;
+    if (prev_count != 0 && q->added_since_wake < q->get_wake_batch)
+        return;
+
+    if (q->added_since_wake > 1)
+        pthread_cond_broadcast(&q->cond_non_empty);
+    else
+        pthread_cond_signal(&q->cond_non_empty);
+    q->added_since_wake = 0;
+    q->wakeups++;
+}
+
+static void wake_producers(queue_t *q, int prev_count, int freed) {
+    q->freed_since_wake += freed;
+
+    if (!q->add_waiters)
+        return;
+    if (prev_count != q->max_count && q->count != 0 &&
+            q->freed_since_wake < q->add_wake_batch)
+        return;
+
+    if (q->freed_since_wake > 1)
+        pthread_cond_broadcast(&q->cond_non_full);
+    else
+        pthread_cond_signal(&q->cond_non_full);
+    q->freed_since_wake = 0;
+    q->wakeups++;
+}
+
+// after a get that slept: values are left for a consumer that sleeps
+static void pass_on_get(queue_t *q, int slept) {
+    if (slept && q->count > 0 && q->get_waiters) {
+        pthread_cond_signal(&q->cond_non_empty);
+        q->wakeups++;
+    }
+}
+
+// after an add that slept: slots are left for a producer that sleeps
+static void pass_on_add(queue_t *q, int slept) {
+    if (slept && q->count < q->max_count && q->add_waiters) {
+        pthread_cond_signal(&q->cond_non_full);
+        q->wakeups++;
+    }
+}
+
+// deadline is absolute CLOCK_MONOTONIC (the condvars use that clock),
+// NULL waits forever
+static int cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *deadline) {
+    if (!deadline)
+        return pthread_cond_wait(cond, mutex);
+
+    return pthread_cond_timedwait(cond, mutex, deadline);
+}
+
+// *slept is set once the caller had to wait
+static int wait_non_full(queue_t *q, const struct timespec *deadline, int *slept) {
+    *slept = 0;
+    while (q->count == q->max_count) {
+        *slept = 1;
+        // slots freed before we went to sleep must not count for us
+        if (!q->add_waiters)
+            q->freed_since_wake = 0;
+        q->add_waiters++;
+        int err = cond_wait_until(&q->cond_non_full, &q->mutex, deadline);
+        q->add_waiters--;
+        q->lock_ops++;
+
+        if (err == ETIMEDOUT && q->count == q->max_count)
+            return ETIMEDOUT;
+    }
+
+    return 0;
+}
+
+static int wait_non_empty(queue_t *q, const struct timespec *deadline, int *slept) {
+    *slept = 0;
+    while (q->count == 0) {
+        *slept = 1;
+        if (!q->get_waiters)
+            q->added_since_wake = 0;
+        q->get_waiters++;
+        int err = cond_wait_until(&q->cond_non_empty, &q->mutex, deadline);
+        q->get_waiters--;
+        q->lock_ops++;
+
+        if (err == ETIMEDOUT && q->count == 0)
+            return ETIMEDOUT;
+    }
+
+    return 0;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+	s->allocs = q->allocs;
+	s->lock_ops = q->lock_ops;
+	s->wakeups = q->wakeups;
+}
 
+queue_t* queue_init(int max_count) {
 	queue_t *q = malloc(sizeof(queue_t));
 	if (!q) {
 		printf("Cannot allocate memory for a queue\n");
@@ -31,30 +194,43 @@ queue_t* queue_init(int max_count) {
 
 	q->add_attempts = q->get_attempts = 0;
 	q->add_count = q->get_count = 0;
+	q->lock_ops = 0;
+
+	q->add_waiters = q->get_waiters = 0;
+	q->freed_since_wake = q->added_since_wake = 0;
+	q->wakeups = 0;
+
+	pool_init(q);
+
+    pthread_condattr_t attr;
+
+    // deadlines of the timed calls are CLOCK_MONOTONIC
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
 
     pthread_mutex_init(&q->mutex, NULL);
-    pthread_cond_init(&q->cond_non_full, NULL);
-    pthread_cond_init(&q->cond_non_empty, NULL);
+    pthread_cond_init(&q->cond_non_full, &attr);
+    pthread_cond_init(&q->cond_non_empty, &attr);
 
-	err = pthread_create(&q->qmonitor_tid, NULL, qmonitor, q);
-	if (err) {
-		printf("queue_init: pthread_create() failed: %s\n", strerror(err));
-		abort();
-	}
+    pthread_condattr_destroy(&attr);
+
+    queue_set_wake_batch(q, QUEUE_WAKE_BATCH, QUEUE_WAKE_BATCH);
+
+	q->mon = qmon_register(q, queue_sample);
 
 	return q;
 }
 
 void queue_destroy(queue_t *q) {
-    pthread_cancel(q->qmonitor_tid);
-    pthread_join(q->qmonitor_tid, NULL);
+    qmon_unregister(q->mon);
 
     qnode_t *current = q->first;
     while (current != NULL) {
         qnode_t *temp = current;
         current = current->next;
-        free(temp);
+        node_free(q, temp);
     }
+    pool_destroy(q);
     
     pthread_mutex_destroy(&q->mutex);
     pthread_cond_destroy(&q->cond_non_full);
@@ -64,18 +240,22 @@ void queue_destroy(queue_t *q) {
 }
 
 int queue_add(queue_t *q, int val) {
+    return queue_add_timed(q, val, NULL) == 0;
+}
+
+int queue_add_timed(queue_t *q, int val, const struct timespec *deadline) {
     pthread_mutex_lock(&q->mutex);
+    q->lock_ops++;
     q->add_attempts++;
 
-    while (q->count == q->max_count) {
-        pthread_cond_wait(&q->cond_non_full, &q->mutex);
-    }
+    int slept;
 
-    qnode_t *new = malloc(sizeof(qnode_t));
-    if (!new) {
-        printf("Cannot allocate memory for new node\n");
-        abort();
+    if (wait_non_full(q, deadline, &slept)) {
+        pthread_mutex_unlock(&q->mutex);
+        return ETIMEDOUT;
     }
+
+    qnode_t *new = node_alloc(q);
     new->val = val;
     new->next = NULL;
 
@@ -89,37 +269,132 @@ int queue_add(queue_t *q, int val) {
     q->count++;
     q->add_count++;
     
-    pthread_cond_signal(&q->cond_non_empty);
+    wake_consumers(q, q->count - 1, 1);
+    pass_on_add(q, slept);
     pthread_mutex_unlock(&q->mutex);
     
-    return 1;
+    return 0;
 }
 
 int queue_get(queue_t *q, int *val) {
+    return queue_get_timed(q, val, NULL) == 0;
+}
+
+int queue_get_timed(queue_t *q, int *val, const struct timespec *deadline) {
     pthread_mutex_lock(&q->mutex);
+    q->lock_ops++;
     q->get_attempts++;
 
-    while (q->count == 0) {
-        pthread_cond_wait(&q->cond_non_empty, &q->mutex);
+    int slept;
+
+    if (wait_non_empty(q, deadline, &slept)) {
+        pthread_mutex_unlock(&q->mutex);
+        return ETIMEDOUT;
     }
 
     qnode_t *tmp = q->first;
     *val = tmp->val;
     q->first = q->first->next;
 
-    free(tmp);
+    node_free(q, tmp);
     q->count--;
     q->get_count++;
     
-    pthread_cond_signal(&q->cond_non_full);
+    wake_producers(q, q->count + 1, 1);
+    pass_on_get(q, slept);
     pthread_mutex_unlock(&q->mutex);
     
-    return 1;
+    return 0;
+}
+
+int queue_add_many(queue_t *q, const int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    pthread_mutex_lock(&q->mutex);
+    q->lock_ops++;
+    int slept;
+
+    wait_non_full(q, NULL, &slept);
+
+    int k = q->max_count - q->count;
+    if (k > n)
+        k = n;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *new = node_alloc(q);
+        new->val = vals[i];
+        new->next = NULL;
+
+        if (!q->first)
+            q->first = q->last = new;
+        else {
+            q->last->next = new;
+            q->last = new;
+        }
+    }
+
+    // one attempt per value asked for, counted with the values moved
+    // so a call blocked across a monitor sample does not skew the rate
+    q->add_attempts += n;
+    q->count += k;
+    q->add_count += k;
+
+    wake_consumers(q, q->count - k, k);
+    pass_on_add(q, slept);
+    pthread_mutex_unlock(&q->mutex);
+
+    return k;
+}
+
+int queue_get_many(queue_t *q, int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    pthread_mutex_lock(&q->mutex);
+    q->lock_ops++;
+    int slept;
+
+    wait_non_empty(q, NULL, &slept);
+
+    int k = q->count;
+    if (k > n)
+        k = n;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *tmp = q->first;
+        vals[i] = tmp->val;
+        q->first = q->first->next;
+        node_free(q, tmp);
+    }
+
+    q->get_attempts += n;
+    q->count -= k;
+    q->get_count += k;
+
+    wake_producers(q, q->count + k, k);
+    pass_on_get(q, slept);
+    pthread_mutex_unlock(&q->mutex);
+
+    return k;
+}
+
+// thresholds are clamped to [1, max_count]; 1 wakes on every change
+void queue_set_wake_batch(queue_t *q, int get_batch, int add_batch) {
+    pthread_mutex_lock(&q->mutex);
+
+    q->get_wake_batch = get_batch < 1 ? 1 : get_batch > q->max_count ? q->max_count : get_batch;
+    q->add_wake_batch = add_batch < 1 ? 1 : add_batch > q->max_count ? q->max_count : add_batch;
+
+    pthread_mutex_unlock(&q->mutex);
 }
 
 void queue_print_stats(queue_t *q) {
-	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+	long elems = q->add_count + q->get_count;
+
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); allocs %ld; lock ops/elem %.3f; wakeups %ld\n",
 		q->count,
 		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
-		q->add_count, q->get_count, q->add_count -q->get_count);
+		q->add_count, q->get_count, q->add_count -q->get_count,
+		q->allocs, elems ? (double)q->lock_ops / elems : 0.0, q->wakeups);
 }
\ No newline at end of file
@@ -9,6 +9,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
+
+#include "qmon.h"
+
+// default wakeup thresholds, see queue_set_wake_batch()
+#define QUEUE_WAKE_BATCH 16
 
 typedef struct _QueueNode {
 	int val;
@@ -19,7 +25,12 @@ typedef struct _Queue {
     qnode_t *first;
     qnode_t *last;
     
-    pthread_t qmonitor_tid;
+    qmon_entry_t *mon;
+    
+    // preallocated slab of max_count nodes recycled through free_list
+    qnode_t *pool;
+    qnode_t *free_list;
+    long allocs;
     
     int count;
     int max_count;
@@ -28,6 +39,16 @@ typedef struct _Queue {
     long get_attempts;
     long add_count;
     long get_count;
+    long lock_ops;
+
+    // wakeup coalescing, see queue_set_wake_batch()
+    int add_waiters;
+    int get_waiters;
+    int add_wake_batch;
+    int get_wake_batch;
+    int freed_since_wake;
+    int added_since_wake;
+    long wakeups;
 
     pthread_mutex_t mutex;
     pthread_cond_t cond_non_full;
@@ -38,6 +59,17 @@ queue_t* queue_init(int max_count);
 void queue_destroy(queue_t *q);
 int queue_add(queue_t *q, int val);
 int queue_get(queue_t *q, int *val);
+
+// deadline is an absolute CLOCK_MONOTONIC time (NULL: no deadline);
+// 0 on success, ETIMEDOUT if the queue stayed full/empty until then
+int queue_add_timed(queue_t *q, int val, const struct timespec *deadline);
+int queue_get_timed(queue_t *q, int *val, const struct timespec *deadline);
+
+// block until at least one value moves, then move up to n of them;
+// return how many moved (0 without waiting if n <= 0)
+int queue_add_many(queue_t *q, const int *vals, int n);
+int queue_get_many(queue_t *q, int *vals, int n);
+void queue_set_wake_batch(queue_t *q, int get_batch, int add_batch);
 void queue_print_stats(queue_t *q);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "queue.h"
+
+static _Atomic unsigned long queue_ids;
+
+static pthread_once_t records_once = PTHREAD_ONCE_INIT;
+static pthread_key_t records_key;
+
+// the records of this thread in all queues
+static __thread fc_rec_t *thread_records;
+
+// the last queue this thread used and its record there
+static __thread unsigned long record_queue_id;
+static __thread fc_rec_t *record_slot;
+
+// gives the records of an exiting thread back to their queues
+static void records_release(void *arg) {
+	fc_rec_t *r = (fc_rec_t *)arg;
+
+	while (r) {
+		// a new owner may rewrite thread_next as soon as r is free
+		fc_rec_t *next = r->thread_next;
+
+		if (atomic_exchange(&r->state, QUEUE_FC_FREE) == QUEUE_FC_DEAD)
+			free(r);
+		r = next;
+	}
+}
+
+static void records_key_init(void) {
+	if (pthread_key_create(&records_key, records_release)) {
+		printf("queue: pthread_key_create() failed\n");
+		abort();
+	}
+}
+
+static fc_rec_t *queue_record(queue_t *q) {
+	if (record_queue_id == q->id)
+		return record_slot;
+
+	fc_rec_t *r;
+
+	for (r = thread_records; r; r = r->thread_next)
+		if (r->queue_id == q->id)
+			break;
+
+	if (!r) {
+		pthread_once(&records_once, records_key_init);
+
+		for (r = atomic_load(&q->records); r; r = r->next) {
+			int state = QUEUE_FC_FREE;
+
+			if (atomic_load_explicit(&r->state, memory_order_relaxed) == QUEUE_FC_FREE &&
+					atomic_compare_exchange_strong(&r->state, &state, QUEUE_FC_USED))
+				break;
+		}
+
+		if (!r) {
+			r = aligned_alloc(CACHE_LINE, sizeof(fc_rec_t));
+			if (!r) {
+				printf("Cannot allocate memory for a combining record\n");
+				abort();
+			}
+			atomic_store(&r->op, QUEUE_FC_NONE);
+			atomic_store(&r->state, QUEUE_FC_USED);
+
+			r->next = atomic_load(&q->records);
+			while (!atomic_compare_exchange_weak(&q->records, &r->next, r))
+				;
+			atomic_fetch_add(&q->nrecords, 1);
+		}
+
+		r->queue_id = q->id;
+		r->thread_next = thread_records;
+		thread_records = r;
+		pthread_setspecific(records_key, r);
+	}
+
+	record_queue_id = q->id;
+	record_slot = r;
+
+	return r;
+}
+
+// called by the monitor thread; the counters are read without the lock
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->buf = malloc(max_count * sizeof(int));
+	if (!q->buf) {
+		printf("Cannot allocate memory for queue buffer\n");
+		abort();
+	}
+
+	q->max_count = max_count;
+	q->head = q->count = 0;
+
+	q->id = atomic_fetch_add(&queue_ids, 1) + 1;
+	atomic_store(&q->lock, 0);
+	atomic_store(&q->records, NULL);
+	atomic_store(&q->nrecords, 0);
+
+	q->add_attempts = q->get_attempts = 0;
+	q->add_count = q->get_count = 0;
+	q->combines = q->combined = 0;
+
+	q->last_get_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+    qmon_unregister(q->mon);
+
+    // records of threads still running are freed when they exit
+    fc_rec_t *r = atomic_load(&q->records);
+    while (r) {
+        fc_rec_t *next = r->next;
+        if (atomic_exchange(&r->state, QUEUE_FC_DEAD) == QUEUE_FC_FREE)
+            free(r);
+        r = next;
+    }
+
+    free(q->buf);
+    free(q);
+}
+
+// the sequential queue, only ever run by the combiner
+static void apply(queue_t *q, fc_rec_t *r, int op) {
+    if (op == QUEUE_FC_ADD) {
+        q->add_attempts++;
+        r->ret = q->count < q->max_count;
+        if (r->ret) {
+            int tail = q->head + q->count;
+            q->buf[tail >= q->max_count ? tail - q->max_count : tail] = r->val;
+            q->count++;
+            q->add_count++;
+        }
+    } else {
+        q->get_attempts++;
+        r->ret = q->count > 0;
+        if (r->ret) {
+            r->val = q->buf[q->head];
+            q->head = q->head + 1 == q->max_count ? 0 : q->head + 1;
+            q->count--;
+            q->get_count++;
+        }
+    }
+}
+
+static void combine(queue_t *q) {
+    q->combines++;
+
+    for (int pass = 0; pass < QUEUE_FC_PASSES; pass++) {
+        int served = 0;
+
+        for (fc_rec_t *r = atomic_load(&q->records); r; r = r->next) {
+            int op = atomic_load_explicit(&r->op, memory_order_acquire);
+            if (op == QUEUE_FC_NONE)
+                continue;
+
+            apply(q, r, op);
+            atomic_store_explicit(&r->op, QUEUE_FC_NONE, memory_order_release);
+            served++;
+        }
+
+        q->combined += served;
+        if (!served)
+            break;
+    }
+}
+
+static int try_lock(queue_t *q) {
+    return !atomic_load_explicit(&q->lock, memory_order_relaxed) &&
+        !atomic_exchange_explicit(&q->lock, 1, memory_order_acquire);
+}
+
+static int fc_request(queue_t *q, int op, int *val) {
+    fc_rec_t *r = queue_record(q);
+
+    if (op == QUEUE_FC_ADD)
+        r->val = *val;
+    atomic_store_explicit(&r->op, op, memory_order_release);
+
+    // either someone combines for us, or we become the combiner
+    while (1) {
+        for (int i = 0; i < QUEUE_FC_SPIN; i++) {
+            if (atomic_load_explicit(&r->op, memory_order_acquire) == QUEUE_FC_NONE)
+                goto served;
+
+            if (try_lock(q)) {
+                combine(q);
+                atomic_store_explicit(&q->lock, 0, memory_order_release);
+
+                // the combiner serves its own record in the first pass
+                goto served;
+            }
+        }
+        sched_yield();
+    }
+
+served:
+    if (op == QUEUE_FC_GET && r->ret)
+        *val = r->val;
+    return r->ret;
+}
+
+int queue_add(queue_t *q, int val) {
+    return fc_request(q, QUEUE_FC_ADD, &val);
+}
+
+int queue_get(queue_t *q, int *val) {
+    return fc_request(q, QUEUE_FC_GET, val);
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (q->get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = q->get_count;
+	q->last_ts = now;
+
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); combines %ld (%.2f requests each); %ld records; %.0f ops/s\n",
+		q->count,
+		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
+		q->add_count, q->get_count, q->add_count - q->get_count,
+		q->combines, q->combines ? (double)q->combined / q->combines : 0.0,
+		atomic_load(&q->nrecords), ops);
+}
@@ -0,0 +1,94 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+// spins on the own record before yielding the CPU
+#define QUEUE_FC_SPIN 128
+// passes over the records per combining round
+#define QUEUE_FC_PASSES 2
+
+enum {
+	QUEUE_FC_NONE,
+	QUEUE_FC_ADD,
+	QUEUE_FC_GET,
+};
+
+// record states
+enum {
+	QUEUE_FC_USED,	// owned by a live thread
+	QUEUE_FC_FREE,	// owner exited, the next new thread takes it
+	QUEUE_FC_DEAD,	// queue destroyed, the owner frees it when it exits
+};
+
+/*
+ * Flat combining (Hendler, Incze, Shavit, Tzafrir).
+ * Every thread owns a publication record per queue. To add or get it
+ * posts the request in its record and tries the combiner lock; the
+ * winner applies all posted requests to the ring in one go and the
+ * others just wait for their record to be answered. Only the combiner
+ * touches the ring and the counters, so they stay in one core's cache
+ * while the rest of the threads spin on their own cache line.
+ * A thread gets a record on its first call, taking a free one if there
+ * is any. When the thread exits its records are marked free, so the
+ * record list (and the combining scan) is as long as the most threads
+ * that used the queue at the same time.
+ */
+typedef struct _FcRecord {
+	_Alignas(CACHE_LINE) _Atomic int op;	// back to QUEUE_FC_NONE when served
+	int val;	// in for add, out for get
+	int ret;
+
+	_Atomic int state;
+	unsigned long queue_id;
+	struct _FcRecord *next;		// in the queue's list
+	struct _FcRecord *thread_next;	// in the owner's list
+} fc_rec_t;
+
+typedef struct _Queue {
+	// owned by the combiner
+	int *buf;
+	int max_count;
+	int head;
+	int count;
+
+	unsigned long id;
+	qmon_entry_t *mon;
+
+	_Alignas(CACHE_LINE) _Atomic int lock;
+	_Alignas(CACHE_LINE) _Atomic(fc_rec_t *) records;
+	_Atomic long nrecords;
+
+	// queue statistics, written by the combiner only
+	_Alignas(CACHE_LINE) long add_attempts;
+	long get_attempts;
+	long add_count;
+	long get_count;
+	long combines;
+	long combined;
+
+	// owned by queue_print_stats, used for the rate
+	long last_get_count;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Context switches per million operations for the blocking queues.
+ * One writer and one reader move a fixed number of values through a
+ * small queue, then getrusage() reports the switches of the process.
+ * Linked against this directory's futex queue and against 2-2/f.
+ */
+
+#ifndef VARIANT
+#define VARIANT "queue"
+#endif
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+static long ops = 1000000;
+
+void *reader(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	int expected = 0;
+
+	for (long i = 0; i < ops; i++) {
+		int val = -1;
+		queue_get(q, &val);
+
+		if (expected != val)
+			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+
+		expected = val + 1;
+	}
+
+	return NULL;
+}
+
+void *writer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+
+	for (long i = 0; i < ops; i++)
+		queue_add(q, i);
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	pthread_t tid_reader, tid_writer;
+	struct rusage before, after;
+	struct timespec start, end;
+	int max_count = 64;
+	int err;
+
+	if (argc > 1)
+		ops = atol(argv[1]);
+	if (argc > 2)
+		max_count = atoi(argv[2]);
+	if (ops <= 0 || max_count <= 0) {
+		printf("usage: %s [ops] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	queue_t *q = queue_init(max_count);
+
+	getrusage(RUSAGE_SELF, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	err = pthread_create(&tid_reader, NULL, reader, q);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	err = pthread_create(&tid_writer, NULL, writer, q);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	pthread_join(tid_reader, NULL);
+	pthread_join(tid_writer, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &after);
+
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	double scale = 1e6 / ops;
+
+	printf("csw: %-6s ops %ld max_count %d: %10.0f ops/s; per 1M ops: %8.0f voluntary %8.0f involuntary\n",
+		VARIANT, ops, max_count, ops / secs,
+		(after.ru_nvcsw - before.ru_nvcsw) * scale,
+		(after.ru_nivcsw - before.ru_nivcsw) * scale);
+
+	queue_print_stats(q);
+	queue_destroy(q);
+
+	return 0;
+}
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "queue.h"
+
+static void pool_init(queue_t *q) {
+	q->pool = malloc(q->max_count * sizeof(qnode_t));
+	if (!q->pool) {
+		printf("Cannot allocate memory for node pool\n");
+		abort();
+	}
+
+	q->free_list = NULL;
+	for (int i = q->max_count - 1; i >= 0; i--) {
+		q->pool[i].next = q->free_list;
+		q->free_list = &q->pool[i];
+	}
+
+	q->allocs = 0;
+}
+
+// callers hold the queue lock
+static qnode_t *node_alloc(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	if (n) {
+		q->free_list = n->next;
+		return n;
+	}
+
+	n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	q->allocs++;
+
+	return n;
+}
+
+static void node_free(queue_t *q, qnode_t *n) {
+	n->next = q->free_list;
+	q->free_list = n;
+}
+
+static void pool_destroy(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	while (n) {
+		qnode_t *next = n->next;
+		if (n < q->pool || n >= q->pool + q->max_count)
+			free(n);
+		n = next;
+	}
+
+	free(q->pool);
+}
+
+static void futex_wait(_Atomic uint32_t *word, uint32_t val) {
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word, int n) {
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/*
+ * Called with q->mutex held while the wanted state (non-empty or
+ * non-full) does not hold; returns with q->mutex held again.
+ * First spins on count without the lock, then parks on the futex word.
+ * The waker bumps the word under the same mutex, so a bump between
+ * our unlock and FUTEX_WAIT makes the wait return at once.
+ */
+static void queue_wait(queue_t *q, qwait_t *w, int blocked_count, int *spins) {
+	if (*spins < q->spin) {
+		pthread_mutex_unlock(&q->mutex);
+		while (*spins < q->spin && __atomic_load_n(&q->count, __ATOMIC_RELAXED) == blocked_count) {
+			cpu_relax();
+			(*spins)++;
+		}
+		pthread_mutex_lock(&q->mutex);
+		return;
+	}
+
+	uint32_t seq = atomic_load_explicit(&w->seq, memory_order_relaxed);
+
+	w->waiters++;
+	q->sleeps++;
+	pthread_mutex_unlock(&q->mutex);
+
+	futex_wait(&w->seq, seq);
+
+	pthread_mutex_lock(&q->mutex);
+	w->waiters--;
+	if (w->woken)
+		w->woken--;
+}
+
+/*
+ * Called with q->mutex held after the state changed; returns 1 if the
+ * caller must FUTEX_WAKE one thread after unlocking. Nobody parked, or
+ * everybody parked already woken, means no syscall at all.
+ */
+static int queue_notify(queue_t *q, qwait_t *w) {
+	if (w->waiters <= w->woken)
+		return 0;
+
+	atomic_fetch_add_explicit(&w->seq, 1, memory_order_relaxed);
+	w->woken++;
+	q->wakes++;
+	return 1;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+	s->wakeups = q->wakes;
+	s->syscalls = q->sleeps + q->wakes;
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = malloc(sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->first = NULL;
+	q->last = NULL;
+	q->max_count = max_count;
+	q->count = 0;
+
+	q->add_attempts = q->get_attempts = 0;
+	q->add_count = q->get_count = 0;
+	q->sleeps = q->wakes = 0;
+
+	pool_init(q);
+
+	pthread_mutex_init(&q->mutex, NULL);
+	memset(&q->non_full, 0, sizeof(q->non_full));
+	memset(&q->non_empty, 0, sizeof(q->non_empty));
+
+	// spinning only helps if the other side runs on another cpu
+	q->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? QUEUE_SPIN : 0;
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	qnode_t *current = q->first;
+	while (current != NULL) {
+		qnode_t *temp = current;
+		current = current->next;
+		node_free(q, temp);
+	}
+	pool_destroy(q);
+
+	pthread_mutex_destroy(&q->mutex);
+
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	int spins = 0;
+
+	pthread_mutex_lock(&q->mutex);
+	q->add_attempts++;
+
+	while (q->count == q->max_count)
+		queue_wait(q, &q->non_full, q->max_count, &spins);
+
+	qnode_t *new = node_alloc(q);
+	new->val = val;
+	new->next = NULL;
+
+	if (!q->first)
+		q->first = q->last = new;
+	else {
+		q->last->next = new;
+		q->last = q->last->next;
+	}
+
+	q->count++;
+	q->add_count++;
+
+	int wake = queue_notify(q, &q->non_empty);
+	pthread_mutex_unlock(&q->mutex);
+
+	if (wake)
+		futex_wake(&q->non_empty.seq, 1);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	int spins = 0;
+
+	pthread_mutex_lock(&q->mutex);
+	q->get_attempts++;
+
+	while (q->count == 0)
+		queue_wait(q, &q->non_empty, 0, &spins);
+
+	qnode_t *tmp = q->first;
+	*val = tmp->val;
+	q->first = q->first->next;
+
+	node_free(q, tmp);
+	q->count--;
+	q->get_count++;
+
+	int wake = queue_notify(q, &q->non_full);
+	pthread_mutex_unlock(&q->mutex);
+
+	if (wake)
+		futex_wake(&q->non_full.seq, 1);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); sleeps %ld wakes %ld\n",
+		q->count,
+		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
+		q->add_count, q->get_count, q->add_count -q->get_count,
+		q->sleeps, q->wakes);
+}
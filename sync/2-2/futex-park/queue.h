@@ -0,0 +1,68 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "qmon.h"
+
+// lock-free re-checks of count before a thread parks on a futex
+#define QUEUE_SPIN 1000
+
+typedef struct _QueueNode {
+	int val;
+	struct _QueueNode *next;
+} qnode_t;
+
+// a futex word plus the threads parked on it, protected by the queue mutex
+typedef struct _QueueWait {
+	_Atomic uint32_t seq;
+	int waiters;	// parked or about to park
+	int woken;	// woken, but not back under the mutex yet
+} qwait_t;
+
+typedef struct _Queue {
+    qnode_t *first;
+    qnode_t *last;
+
+    qmon_entry_t *mon;
+
+    // preallocated slab of max_count nodes recycled through free_list
+    qnode_t *pool;
+    qnode_t *free_list;
+    long allocs;
+
+    int count;
+    int max_count;
+
+    long add_attempts;
+    long get_attempts;
+    long add_count;
+    long get_count;
+
+    // wakeup accounting: parked threads and FUTEX_WAKE calls
+    long sleeps;
+    long wakes;
+
+    pthread_mutex_t mutex;
+
+    qwait_t non_full;
+    qwait_t non_empty;
+    int spin;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif
@@ -0,0 +1,59 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "fsem.h"
+
+void fsem_init(fsem_t *s, int value) {
+	atomic_store(&s->value, value);
+	atomic_store(&s->waiters, 0);
+	atomic_store(&s->waits, 0);
+	atomic_store(&s->wakes, 0);
+}
+
+int fsem_trywait(fsem_t *s) {
+	int v = atomic_load_explicit(&s->value, memory_order_relaxed);
+
+	while (v > 0) {
+		if (atomic_compare_exchange_weak_explicit(&s->value, &v, v - 1,
+				memory_order_acquire, memory_order_relaxed))
+			return 0;
+	}
+
+	return EAGAIN;
+}
+
+int fsem_wait(fsem_t *s, const struct timespec *deadline) {
+	while (fsem_trywait(s)) {
+		// seq_cst against the value/waiters pair in fsem_post()
+		atomic_fetch_add(&s->waiters, 1);
+		atomic_fetch_add_explicit(&s->waits, 1, memory_order_relaxed);
+
+		// FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC timeout;
+		// fails with EAGAIN if a post got in after the trywait
+		long err = syscall(SYS_futex, &s->value, FUTEX_WAIT_BITSET_PRIVATE, 0,
+			deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+		if (!err)
+			continue;	// the waker already deregistered us
+
+		atomic_fetch_sub(&s->waiters, 1);
+		if (errno == ETIMEDOUT)
+			return fsem_trywait(s) ? ETIMEDOUT : 0;
+	}
+
+	return 0;
+}
+
+void fsem_post(fsem_t *s, int n) {
+	atomic_fetch_add(&s->value, n);
+
+	if (atomic_load(&s->waiters) == 0)
+		return;
+
+	atomic_fetch_add_explicit(&s->wakes, 1, memory_order_relaxed);
+	long woken = syscall(SYS_futex, &s->value, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+	if (woken > 0)
+		atomic_fetch_sub(&s->waiters, woken);
+}
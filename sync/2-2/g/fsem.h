@@ -0,0 +1,36 @@
+#ifndef __FITOS_FSEM_H__
+#define __FITOS_FSEM_H__
+
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * Futex-backed counting semaphore.
+ * wait/post are a single CAS on value while it stays positive. A waiter
+ * that finds it 0 registers in waiters and sleeps in FUTEX_WAIT; a post
+ * only calls FUTEX_WAKE while someone is registered, and takes the threads
+ * the kernel actually woke off waiters itself, so posts racing with a
+ * woken waiter that has not run yet do not wake again.
+ * waits/wakes count the futex syscalls made, for the stats.
+ */
+typedef struct _FutexSem {
+	_Atomic int value;
+	_Atomic int waiters;
+
+	_Atomic long waits;
+	_Atomic long wakes;
+} fsem_t;
+
+void fsem_init(fsem_t *s, int value);
+
+// deadline is absolute CLOCK_MONOTONIC, NULL waits forever;
+// 0 on success, ETIMEDOUT
+int fsem_wait(fsem_t *s, const struct timespec *deadline);
+
+// 0 on success, EAGAIN if the counter is 0
+int fsem_trywait(fsem_t *s);
+
+// adds n and wakes up to n waiters with one syscall
+void fsem_post(fsem_t *s, int n);
+
+#endif		// __FITOS_FSEM_H__
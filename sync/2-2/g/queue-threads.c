@@ -13,6 +13,9 @@
 #define RED "\033[41m"
 #define NOCOLOR "\033[0m"
 
+// values moved per queue call; > 1 switches to queue_add_many/queue_get_many
+static int batch = 1;
+
 void set_cpu(int n) {
 	int err;
 	cpu_set_t cpuset;
@@ -36,16 +39,21 @@ void *reader(void *arg) {
 
 	set_cpu(1);
 
+	int *vals = malloc(batch * sizeof(int));
+	if (!vals) {
+		printf("reader: cannot allocate batch buffer\n");
+		return NULL;
+	}
+
 	while (1) {
-		int val = -1;
-		int ok = queue_get(q, &val);
-		if (!ok)
-			continue;
+		int n = batch > 1 ? queue_get_many(q, vals, batch) : queue_get(q, &vals[0]);
 
-		if (expected != val)
-			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+		for (int j = 0; j < n; j++) {
+			if (expected != vals[j])
+				printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", vals[j], expected);
 
-		expected = val + 1;
+			expected = vals[j] + 1;
+		}
 	}
 	return NULL;
 }
@@ -57,20 +65,31 @@ void *writer(void *arg) {
 
 	set_cpu(2);
 
+	int *vals = malloc(batch * sizeof(int));
+	if (!vals) {
+		printf("writer: cannot allocate batch buffer\n");
+		return NULL;
+	}
+
 	while (1) {
-		int ok = queue_add(q, i);
-		if (!ok)
-			continue;
-		i++;
+		for (int j = 0; j < batch; j++)
+			vals[j] = i + j;
+
+		i += batch > 1 ? queue_add_many(q, vals, batch) : queue_add(q, i);
 	}
 	return NULL;
 }
 
-int main() {
+int main(int argc, char **argv) {
 	pthread_t tid_reader, tid_writer;
 	queue_t *q;
 	int err;
 
+	if (argc > 1)
+		batch = atoi(argv[1]);
+	if (batch < 1)
+		batch = 1;
+
 	printf("main [%d %d %d]\n", getpid(), getppid(), gettid());
 
 	q = queue_init(1000000);
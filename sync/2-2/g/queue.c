@@ -1,24 +1,164 @@
 #define _GNU_SOURCE
 #include <pthread.h>
 #include <assert.h>
-#include <semaphore.h>
 
 #include "queue.h"
 
-void *qmonitor(void *arg) {
-	queue_t *q = (queue_t *)arg;
-	printf("qmonitor: [%d %d %d]\n", getpid(), getppid(), gettid());
+#ifdef QUEUE_POSIX_SEM
+static void qsem_init(qsem_t *s, int value) {
+    if (sem_init(s, 0, value) != 0)
+        abort();
+}
+
+// deadline is absolute CLOCK_MONOTONIC, NULL waits forever
+static int qsem_wait(qsem_t *s, const struct timespec *deadline) {
+    int err;
+
+    do {
+        err = deadline ? sem_clockwait(s, CLOCK_MONOTONIC, deadline) : sem_wait(s);
+    } while (err && errno == EINTR);
+
+    return err ? errno : 0;
+}
 
-	while (1) {
-		queue_print_stats(q);
-		sleep(1);
+static int qsem_trywait(qsem_t *s) {
+    return sem_trywait(s) ? errno : 0;
+}
+
+static void qsem_post(qsem_t *s, int n) {
+    while (n-- > 0)
+        sem_post(s);
+}
+
+static void qsem_destroy(qsem_t *s) {
+    sem_destroy(s);
+}
+
+static void qlock_init(qlock_t *l) {
+    qsem_init(l, 1);
+}
+
+static void qlock(qlock_t *l) {
+    qsem_wait(l, NULL);
+}
+
+static void qunlock(qlock_t *l) {
+    sem_post(l);
+}
+
+static void qlock_destroy(qlock_t *l) {
+    sem_destroy(l);
+}
+#else
+static void qsem_init(qsem_t *s, int value) {
+    fsem_init(s, value);
+}
+
+static int qsem_wait(qsem_t *s, const struct timespec *deadline) {
+    return fsem_wait(s, deadline);
+}
+
+static int qsem_trywait(qsem_t *s) {
+    return fsem_trywait(s);
+}
+
+// one FUTEX_WAKE for the whole batch
+static void qsem_post(qsem_t *s, int n) {
+    fsem_post(s, n);
+}
+
+static void qsem_destroy(qsem_t *s) {
+}
+
+static void qlock_init(qlock_t *l) {
+    pthread_mutex_init(l, NULL);
+}
+
+static void qlock(qlock_t *l) {
+    pthread_mutex_lock(l);
+}
+
+static void qunlock(qlock_t *l) {
+    pthread_mutex_unlock(l);
+}
+
+static void qlock_destroy(qlock_t *l) {
+    pthread_mutex_destroy(l);
+}
+#endif
+
+static void pool_init(queue_t *q) {
+	q->pool = malloc(q->max_count * sizeof(qnode_t));
+	if (!q->pool) {
+		printf("Cannot allocate memory for node pool\n");
+		abort();
+	}
+
+	q->free_list = NULL;
+	for (int i = q->max_count - 1; i >= 0; i--) {
+		q->pool[i].next = q->free_list;
+		q->free_list = &q->pool[i];
 	}
-	return NULL;
+
+	q->allocs = 0;
 }
 
-queue_t* queue_init(int max_count) {
-	int err;
+// callers hold the queue lock
+static qnode_t *node_alloc(queue_t *q) {
+	qnode_t *n = q->free_list;
+
+	if (n) {
+		q->free_list = n->next;
+		return n;
+	}
+
+	n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	q->allocs++;
+
+	return n;
+}
+
+static void node_free(queue_t *q, qnode_t *n) {
+	n->next = q->free_list;
+	q->free_list = n;
+}
+
+static void pool_destroy(queue_t *q) {
+	qnode_t *n = q->free_list;
 
+	while (n) {
+		qnode_t *next = n->next;
+		if (n < q->pool || n >= q->pool + q->max_count)
+			free(n);
+		n = next;
+	}
+
+	free(q->pool);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+	s->allocs = q->allocs;
+	s->lock_ops = q->lock_ops;
+
+#ifndef QUEUE_POSIX_SEM
+	s->wakeups = atomic_load(&q->sem_full.wakes) + atomic_load(&q->sem_empty.wakes);
+	s->syscalls = atomic_load(&q->sem_full.waits) + atomic_load(&q->sem_empty.waits) + s->wakeups;
+#endif
+}
+
+queue_t* queue_init(int max_count) {
 	queue_t *q = malloc(sizeof(queue_t));
 	if (!q) {
 		printf("Cannot allocate memory for a queue\n");
@@ -32,55 +172,53 @@ queue_t* queue_init(int max_count) {
 
 	q->add_attempts = q->get_attempts = 0;
 	q->add_count = q->get_count = 0;
+	q->lock_ops = 0;
+
+	pool_init(q);
     
-    if (sem_init(&q->sem_mutex, 0, 1) != 0) 
-        abort();
-    
-    if (sem_init(&q->sem_full, 0, 0) != 0) 
-        abort();
-    
-    if (sem_init(&q->sem_empty, 0, max_count) != 0) 
-        abort();
+    qlock_init(&q->lock);
+    qsem_init(&q->sem_full, 0);
+    qsem_init(&q->sem_empty, max_count);
 
-	err = pthread_create(&q->qmonitor_tid, NULL, qmonitor, q);
-	if (err) {
-		printf("queue_init: pthread_create() failed: %s\n", strerror(err));
-		abort();
-	}
+	q->mon = qmon_register(q, queue_sample);
 
 	return q;
 }
 
 void queue_destroy(queue_t *q) {
-    pthread_cancel(q->qmonitor_tid);
-    pthread_join(q->qmonitor_tid, NULL);
+    qmon_unregister(q->mon);
 
     qnode_t *current = q->first;
     while (current != NULL) {
         qnode_t *temp = current;
         current = current->next;
-        free(temp);
+        node_free(q, temp);
     }
+    pool_destroy(q);
     
-    sem_destroy(&q->sem_mutex);
-    sem_destroy(&q->sem_full);
-    sem_destroy(&q->sem_empty);
+    qlock_destroy(&q->lock);
+    qsem_destroy(&q->sem_full);
+    qsem_destroy(&q->sem_empty);
     
     free(q);
 }
 
 int queue_add(queue_t *q, int val) {
-    sem_wait(&q->sem_empty);
+    return queue_add_timed(q, val, NULL) == 0;
+}
+
+int queue_add_timed(queue_t *q, int val, const struct timespec *deadline) {
+    int err = qsem_wait(&q->sem_empty, deadline);
+    if (err)
+        return err;
     
-    sem_wait(&q->sem_mutex);
+    qlock(&q->lock);
+    
+    q->lock_ops++;
     
     q->add_attempts++;
 
-    qnode_t *new = malloc(sizeof(qnode_t));
-    if (!new) {
-        printf("Cannot allocate memory for new node\n");
-        abort();
-    }
+    qnode_t *new = node_alloc(q);
     new->val = val;
     new->next = NULL;
 
@@ -94,17 +232,25 @@ int queue_add(queue_t *q, int val) {
     q->count++;
     q->add_count++;
     
-    sem_post(&q->sem_mutex);
+    qunlock(&q->lock);
     
-    sem_post(&q->sem_full);
+    qsem_post(&q->sem_full, 1);
     
-    return 1;
+    return 0;
 }
 
 int queue_get(queue_t *q, int *val) {
-    sem_wait(&q->sem_full);
+    return queue_get_timed(q, val, NULL) == 0;
+}
+
+int queue_get_timed(queue_t *q, int *val, const struct timespec *deadline) {
+    int err = qsem_wait(&q->sem_full, deadline);
+    if (err)
+        return err;
+    
+    qlock(&q->lock);
     
-    sem_wait(&q->sem_mutex);
+    q->lock_ops++;
     
     q->get_attempts++;
 
@@ -112,20 +258,102 @@ int queue_get(queue_t *q, int *val) {
     *val = tmp->val;
     q->first = q->first->next;
 
-    free(tmp);
+    node_free(q, tmp);
     q->count--;
     q->get_count++;
     
-    sem_post(&q->sem_mutex);
+    qunlock(&q->lock);
     
-    sem_post(&q->sem_empty);
+    qsem_post(&q->sem_empty, 1);
     
-    return 1;
+    return 0;
+}
+
+// blocks for the first slot, then claims whatever else is free right now
+int queue_add_many(queue_t *q, const int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    int k = 1;
+
+    qsem_wait(&q->sem_empty, NULL);
+    while (k < n && qsem_trywait(&q->sem_empty) == 0)
+        k++;
+
+    qlock(&q->lock);
+    q->lock_ops++;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *new = node_alloc(q);
+        new->val = vals[i];
+        new->next = NULL;
+
+        if (!q->first)
+            q->first = q->last = new;
+        else {
+            q->last->next = new;
+            q->last = new;
+        }
+    }
+
+    // one attempt per value asked for, counted with the values moved
+    // so a call blocked across a monitor sample does not skew the rate
+    q->add_attempts += n;
+    q->count += k;
+    q->add_count += k;
+
+    qunlock(&q->lock);
+
+    qsem_post(&q->sem_full, k);
+
+    return k;
+}
+
+int queue_get_many(queue_t *q, int *vals, int n) {
+    if (n <= 0)
+        return 0;
+
+    int k = 1;
+
+    qsem_wait(&q->sem_full, NULL);
+    while (k < n && qsem_trywait(&q->sem_full) == 0)
+        k++;
+
+    qlock(&q->lock);
+    q->lock_ops++;
+
+    for (int i = 0; i < k; i++) {
+        qnode_t *tmp = q->first;
+        vals[i] = tmp->val;
+        q->first = q->first->next;
+        node_free(q, tmp);
+    }
+
+    q->get_attempts += n;
+    q->count -= k;
+    q->get_count += k;
+
+    qunlock(&q->lock);
+
+    qsem_post(&q->sem_empty, k);
+
+    return k;
 }
 
 void queue_print_stats(queue_t *q) {
-	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+	long elems = q->add_count + q->get_count;
+
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); allocs %ld; lock ops/elem %.3f\n",
 		q->count,
 		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
-		q->add_count, q->get_count, q->add_count -q->get_count);
+		q->add_count, q->get_count, q->add_count -q->get_count,
+		q->allocs, elems ? (double)q->lock_ops / elems : 0.0);
+
+#ifndef QUEUE_POSIX_SEM
+	long waits = atomic_load(&q->sem_full.waits) + atomic_load(&q->sem_empty.waits);
+	long wakes = atomic_load(&q->sem_full.wakes) + atomic_load(&q->sem_empty.wakes);
+
+	printf("queue futex: waits %ld wakes %ld; syscalls/value %.3f\n",
+		waits, wakes, elems ? (double)(waits + wakes) * 2 / elems : 0.0);
+#endif
 }
\ No newline at end of file
@@ -9,7 +9,24 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
+
+#include "qmon.h"
+
+/*
+ * Slot counting uses the futex semaphore from fsem.h and the list is
+ * protected by a mutex. Building with -DQUEUE_POSIX_SEM restores the
+ * original sem_t trio (sem_mutex as a binary semaphore) for comparison.
+ */
+#ifdef QUEUE_POSIX_SEM
 #include <semaphore.h>
+typedef sem_t qsem_t;
+typedef sem_t qlock_t;
+#else
+#include "fsem.h"
+typedef fsem_t qsem_t;
+typedef pthread_mutex_t qlock_t;
+#endif
 
 typedef struct _QueueNode {
 	int val;
@@ -20,7 +37,12 @@ typedef struct _Queue {
     qnode_t *first;
     qnode_t *last;
     
-    pthread_t qmonitor_tid;
+    qmon_entry_t *mon;
+    
+    // preallocated slab of max_count nodes recycled through free_list
+    qnode_t *pool;
+    qnode_t *free_list;
+    long allocs;
     
     int count;
     int max_count;
@@ -29,16 +51,27 @@ typedef struct _Queue {
     long get_attempts;
     long add_count;
     long get_count;
+    long lock_ops;
 
-    sem_t sem_full;
-    sem_t sem_empty; 
-    sem_t sem_mutex;
+    qsem_t sem_full;
+    qsem_t sem_empty; 
+    qlock_t lock;
 } queue_t;
 
 queue_t* queue_init(int max_count);
 void queue_destroy(queue_t *q);
 int queue_add(queue_t *q, int val);
 int queue_get(queue_t *q, int *val);
+
+// deadline is an absolute CLOCK_MONOTONIC time (NULL: no deadline);
+// 0 on success, ETIMEDOUT if the queue stayed full/empty until then
+int queue_add_timed(queue_t *q, int val, const struct timespec *deadline);
+int queue_get_timed(queue_t *q, int *val, const struct timespec *deadline);
+
+// block until at least one value moves, then move up to n of them;
+// return how many moved (0 without waiting if n <= 0)
+int queue_add_many(queue_t *q, const int *vals, int n);
+int queue_get_many(queue_t *q, int *vals, int n);
 void queue_print_stats(queue_t *q);
 
 #endif
\ No newline at end of file
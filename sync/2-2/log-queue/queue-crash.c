@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Crash/recovery check. Every round a child process opens the log
+ * (recovering what the previous round left), appends values and reports
+ * each durable watermark it waited for on a pipe, while a consumer
+ * thread reads on from the recovered read position. A value is the low
+ * bits of its sequence number tagged with the process that wrote it, so
+ * records of an earlier process can be told from fresh ones. The child
+ * is SIGKILLed after run_ms; a fresh process then reopens the log and
+ * checks that:
+ *  - every acknowledged durable record survived,
+ *  - the recovered records are exactly head, head + 1, ... and their
+ *    tags never go back to an earlier process,
+ * and then tears the first unacknowledged record, as a power loss that
+ * kept the records after it would. A probe process recovers from that,
+ * appends a few records and exits right after they are durable; the
+ * log is checked again, so a stale record left behind the probe's ones
+ * shows up as a tag going backwards.
+ * SIGKILL leaves the page cache intact, so this exercises the recovery
+ * scan and the watermark bookkeeping rather than the disk.
+ * usage: queue-crash [rounds] [run_ms] [path]
+ */
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+#define CRASH_CAPACITY 4096
+#define CRASH_ACK_EVERY 64
+#define CRASH_PROBE 16
+
+// value = tag << CRASH_SEQ_BITS | low bits of the sequence number; each
+// round uses two tags, so rounds are limited to fit them in an int
+#define CRASH_SEQ_BITS 24
+#define CRASH_SEQ_MASK ((1 << CRASH_SEQ_BITS) - 1)
+#define CRASH_MAX_ROUNDS 63
+
+static int crash_val(int tag, uint64_t seq) {
+	return tag << CRASH_SEQ_BITS | (int)(seq & CRASH_SEQ_MASK);
+}
+
+static const char *path = "queue-crash.log";
+
+static queue_t *queue;
+static int ack_fd;
+static int tag;
+
+void *writer(void *arg) {
+	uint64_t seq = queue_durable(queue);
+
+	while (1) {
+		uint64_t n = queue_append(queue, crash_val(tag, seq));
+		if (!n)
+			continue;
+		seq++;
+
+		if (n % CRASH_ACK_EVERY == 0) {
+			queue_wait_durable(queue, n);
+			if (write(ack_fd, &n, sizeof(n)) != sizeof(n))
+				abort();
+		}
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	long expected = -1;
+	int val;
+
+	while (1) {
+		if (!queue_get(queue, &val))
+			continue;
+
+		val &= CRASH_SEQ_MASK;
+		if (expected >= 0 && val != expected)
+			printf(RED"ERROR: get value is %d but expected - %ld" NOCOLOR "\n", val, expected);
+		expected = (val + 1L) & CRASH_SEQ_MASK;
+	}
+
+	return NULL;
+}
+
+static void run_child(int fd, int t) {
+	pthread_t tid;
+
+	qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue = queue_open(path, CRASH_CAPACITY, 0);
+	if (!queue) {
+		printf("child: cannot open %s: %s\n", path, strerror(errno));
+		_exit(1);
+	}
+	queue_set_commit(queue, 256, 200);
+	ack_fd = fd;
+	tag = t;
+
+	pthread_create(&tid, NULL, reader, NULL);
+	writer(NULL);
+}
+
+// appends CRASH_PROBE records and stops dead once they are durable
+static void run_probe(int fd, int t) {
+	uint64_t n = 0;
+
+	qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue_t *q = queue_open(path, CRASH_CAPACITY, 0);
+	if (!q) {
+		printf("probe: cannot open %s: %s\n", path, strerror(errno));
+		_exit(1);
+	}
+
+	uint64_t seq = q->tail;
+	for (int i = 0; i < CRASH_PROBE; i++, seq++)
+		while (!(n = queue_append(q, crash_val(t, seq))))
+			;
+
+	queue_wait_durable(q, n);
+	if (write(fd, &n, sizeof(n)) != sizeof(n))
+		abort();
+	_exit(0);
+}
+
+// in its own process: the parent stays single-threaded for the next fork
+static int verify(uint64_t acked, int tear) {
+	qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue_t *q = queue_open(path, CRASH_CAPACITY, 0);
+	if (!q) {
+		printf("verify: cannot open %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	int errors = 0;
+
+	if (q->tail < acked) {
+		printf(RED"ERROR: acknowledged durable up to %lu but recovered up to %lu" NOCOLOR "\n",
+			acked, q->tail);
+		errors++;
+	}
+
+	int last = 0;
+
+	for (uint64_t s = q->head; s < q->tail; s++) {
+		int val = q->recs[s % q->capacity].val;
+		int t = val >> CRASH_SEQ_BITS;
+
+		if ((val & CRASH_SEQ_MASK) != (int)(s & CRASH_SEQ_MASK) || t < last) {
+			printf(RED"ERROR: record %lu holds seq %d from process %d, after one from process %d" NOCOLOR "\n",
+				s, val & CRASH_SEQ_MASK, t, last);
+			errors++;
+			break;
+		}
+		last = t;
+	}
+
+	// lose a record the writer was never told is durable, keeping more
+	// than the probe will overwrite after it
+	uint64_t torn = acked > q->head ? acked : q->head;
+
+	if (!errors && tear && q->tail - torn > CRASH_PROBE + 1)
+		q->recs[torn % q->capacity].sum ^= 1;
+	else
+		torn = 0;
+
+	printf("%s: acked %8lu recovered [%8lu, %8lu) %4lu records, %4lu stale dropped%s",
+		tear ? "crash" : "probe", acked, q->head, q->tail, q->recovered, q->dropped,
+		errors ? "" : " ok");
+	if (torn)
+		printf(", tore %lu", torn);
+	printf("\n");
+
+	queue_destroy(q);
+	fflush(stdout);
+
+	return errors != 0;
+}
+
+int main(int argc, char **argv) {
+	int rounds = 5, run_ms = 200;
+	int fds[2];
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		run_ms = atoi(argv[2]);
+	if (argc > 3)
+		path = argv[3];
+
+	if (rounds < 1 || rounds > CRASH_MAX_ROUNDS || run_ms < 1) {
+		printf("usage: %s [rounds] [run_ms] [path]\n", argv[0]);
+		return -1;
+	}
+
+	unlink(path);
+
+	for (int r = 0; r < rounds; r++) {
+		struct timespec run = { .tv_sec = run_ms / 1000, .tv_nsec = run_ms % 1000 * 1000000L };
+		uint64_t acked = 0, n;
+		int status;
+
+		if (pipe(fds)) {
+			perror("pipe");
+			return -1;
+		}
+
+		pid_t pid = fork();
+		if (!pid) {
+			close(fds[0]);
+			run_child(fds[1], 2 * r + 1);
+		}
+		close(fds[1]);
+
+		nanosleep(&run, NULL);
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+
+		while (read(fds[0], &n, sizeof(n)) == sizeof(n))
+			acked = n;
+		close(fds[0]);
+
+		pid = fork();
+		if (!pid)
+			_exit(verify(acked, 1));
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			return 1;
+
+		if (pipe(fds)) {
+			perror("pipe");
+			return -1;
+		}
+
+		pid = fork();
+		if (!pid) {
+			close(fds[0]);
+			run_probe(fds[1], 2 * r + 2);
+		}
+		close(fds[1]);
+		waitpid(pid, &status, 0);
+
+		if (read(fds[0], &acked, sizeof(acked)) != sizeof(acked) ||
+				!WIFEXITED(status) || WEXITSTATUS(status))
+			return 1;
+		close(fds[0]);
+
+		pid = fork();
+		if (!pid)
+			_exit(verify(acked, 0));
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			return 1;
+	}
+
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Group commit throughput. producers append ops values in total while one
+ * consumer drains them (consumers only see durable records, so this is
+ * the rate at which records become durable). With wait = 1 every
+ * producer waits for its record to be durable before appending the next
+ * one, as a caller needing the guarantee per record would; then only the
+ * number of producers sharing a sync amortizes it.
+ * usage: queue-log-bench [producers] [ops] [batch] [interval_us] [wait]
+ */
+
+#define BENCH_PATH "queue-log-bench.log"
+#define BENCH_CAPACITY 65536
+
+static int producers = 4, batch = QUEUE_LOG_BATCH, wait_durable = 0;
+static long ops = 200000, interval_us = QUEUE_LOG_INTERVAL_US;
+
+static queue_t *queue;
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void *writer(void *arg) {
+	long id = (long)arg;
+
+	for (long v = id; v < ops; v += producers) {
+		uint64_t n;
+
+		while (!(n = queue_append(queue, v)))
+			;
+
+		if (wait_durable)
+			queue_wait_durable(queue, n);
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	int val;
+
+	for (long got = 0; got < ops; )
+		got += queue_get(queue, &val);
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	pthread_t tids[65];
+	int err;
+
+	if (argc > 1)
+		producers = atoi(argv[1]);
+	if (argc > 2)
+		ops = atol(argv[2]);
+	if (argc > 3)
+		batch = atoi(argv[3]);
+	if (argc > 4)
+		interval_us = atol(argv[4]);
+	if (argc > 5)
+		wait_durable = atoi(argv[5]);
+
+	if (producers < 1 || producers > 64 || ops < 1 || batch < 1 || interval_us < 0) {
+		printf("usage: %s [producers <= 64] [ops] [batch] [interval_us] [wait]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue = queue_open(BENCH_PATH, BENCH_CAPACITY, QUEUE_LOG_TRUNC);
+	if (!queue) {
+		printf("main: cannot open %s: %s\n", BENCH_PATH, strerror(errno));
+		return -1;
+	}
+	queue_set_commit(queue, batch, interval_us);
+
+	long start = now_ns();
+
+	for (long i = 0; i <= producers; i++) {
+		err = pthread_create(&tids[i], NULL, i < producers ? writer : reader, (void *)i);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+	for (int i = 0; i <= producers; i++)
+		pthread_join(tids[i], NULL);
+
+	double secs = (now_ns() - start) / 1e9;
+
+	printf("log: producers %2d batch %4d interval %6ldus wait %d: %10.0f records/s; commits %6ld (%7.1f records, %7.1fus each)\n",
+		producers, batch, interval_us, wait_durable, ops / secs,
+		queue->commits, (double)ops / queue->commits, queue->commit_ns / 1e3 / queue->commits);
+
+	queue_destroy(queue);
+	unlink(BENCH_PATH);
+
+	return 0;
+}
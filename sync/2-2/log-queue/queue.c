@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "queue.h"
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// catches records torn by a crash in the middle of writing them
+static uint32_t rec_sum(uint64_t seq, int32_t val) {
+	uint64_t x = (seq + 1) * 0x9e3779b97f4a7c15ull ^ (uint32_t)val;
+
+	x ^= x >> 29;
+	return (uint32_t)(x ^ (x >> 32));
+}
+
+static int rec_valid(queue_t *q, uint64_t seq) {
+	qlog_rec_t *r = &q->recs[seq % q->capacity];
+
+	return r->seq == seq + 1 && r->sum == rec_sum(seq, r->val);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	pthread_mutex_lock(&q->mutex);
+	s->count = q->tail - q->head;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+	pthread_mutex_unlock(&q->mutex);
+}
+
+/*
+ * Group commit. The committer sleeps until something changes, then
+ * gives producers interval_ns (or until batch records are pending) to
+ * pile up more, and syncs everything appended and read so far with one
+ * fdatasync. Appends and gets go on while it syncs.
+ */
+static int commit_pending(queue_t *q) {
+	return q->tail != q->durable_tail || q->head != q->durable_head;
+}
+
+void *committer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+
+	pthread_mutex_lock(&q->mutex);
+
+	while (1) {
+		while (!q->stop && !commit_pending(q)) {
+			q->idle = 1;
+			pthread_cond_wait(&q->cond_commit, &q->mutex);
+		}
+		q->idle = 0;
+
+		if (!q->stop && q->interval_ns > 0) {
+			long t = now_ns() + q->interval_ns;
+			struct timespec deadline = { .tv_sec = t / 1000000000L, .tv_nsec = t % 1000000000L };
+
+			while (!q->stop && q->tail - q->durable_tail < (uint64_t)q->batch)
+				if (pthread_cond_timedwait(&q->cond_commit, &q->mutex, &deadline) == ETIMEDOUT)
+					break;
+		}
+
+		if (!commit_pending(q))
+			break;	// stopping and everything is synced
+
+		uint64_t tail = q->tail, head = q->head;
+
+		q->hdr->read_seq = head;
+		pthread_mutex_unlock(&q->mutex);
+
+		long start = now_ns();
+		if (fdatasync(q->fd))
+			perror("queue committer: fdatasync");
+		long took = now_ns() - start;
+
+		pthread_mutex_lock(&q->mutex);
+		q->durable_tail = tail;
+		q->durable_head = head;
+		q->commits++;
+		q->commit_ns += took;
+		pthread_cond_broadcast(&q->cond_durable);
+	}
+
+	pthread_mutex_unlock(&q->mutex);
+
+	return NULL;
+}
+
+// a change while the committer is idle starts the next interval
+static void commit_kick(queue_t *q) {
+	if (q->idle || q->tail - q->durable_tail == (uint64_t)q->batch) {
+		q->idle = 0;
+		pthread_cond_signal(&q->cond_commit);
+	}
+}
+
+// maps the file, setting up the header of a new one
+static int log_map(queue_t *q, int fresh, uint64_t capacity) {
+	q->capacity = capacity;
+	q->map_size = QUEUE_LOG_PAGE + capacity * sizeof(qlog_rec_t);
+
+	if (fresh && ftruncate(q->fd, q->map_size))
+		return -1;
+
+	void *p = mmap(NULL, q->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+
+	q->hdr = p;
+	q->recs = (qlog_rec_t *)((char *)p + QUEUE_LOG_PAGE);
+
+	if (fresh) {
+		q->hdr->magic = QUEUE_LOG_MAGIC;
+		q->hdr->record_size = sizeof(qlog_rec_t);
+		q->hdr->capacity = capacity;
+		q->hdr->read_seq = 0;
+		if (fdatasync(q->fd)) {
+			munmap(p, q->map_size);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+queue_t* queue_open(const char *path, int max_count, int flags) {
+	qlog_hdr_t hdr;
+	struct stat st;
+	int err;
+
+	assert(max_count > 0);
+
+	queue_t *q = malloc(sizeof(queue_t));
+	if (!q) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	q->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | (flags & QUEUE_LOG_TRUNC ? O_TRUNC : 0), 0644);
+	if (q->fd < 0)
+		goto fail_free;
+
+	if (fstat(q->fd, &st))
+		goto fail_close;
+
+	int fresh = st.st_size == 0;
+	uint64_t capacity = max_count;
+
+	// an existing log keeps its own capacity
+	if (!fresh) {
+		if (pread(q->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+				hdr.magic != QUEUE_LOG_MAGIC || hdr.record_size != sizeof(qlog_rec_t) ||
+				st.st_size < (off_t)(QUEUE_LOG_PAGE + hdr.capacity * sizeof(qlog_rec_t))) {
+			errno = EINVAL;
+			goto fail_close;
+		}
+		capacity = hdr.capacity;
+	}
+
+	if (log_map(q, fresh, capacity))
+		goto fail_close;
+
+	// recovery: valid records following the read position
+	q->head = q->hdr->read_seq;
+	q->tail = q->head;
+	while (q->tail - q->head < q->capacity && rec_valid(q, q->tail))
+		q->tail++;
+
+	// a crash can lose a record while later ones made it to the file;
+	// drop those, or they come back after the next crash once the slots
+	// before them are written again. Anything in a slot past tail that
+	// claims a position at or after tail is such a leftover.
+	q->dropped = 0;
+	for (uint64_t s = q->tail; s < q->head + q->capacity; s++) {
+		qlog_rec_t *r = &q->recs[s % q->capacity];
+
+		if (r->seq > q->tail) {
+			r->seq = 0;
+			q->dropped++;
+		}
+	}
+	if (q->dropped && fdatasync(q->fd))
+		goto fail_unmap;
+
+	q->recovered = q->tail - q->head;
+	q->durable_tail = q->tail;
+	q->durable_head = q->head;
+
+	q->add_attempts = q->get_attempts = 0;
+	q->add_count = q->get_count = 0;
+	q->commits = q->commit_ns = 0;
+
+	q->last_get_count = q->last_commits = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&q->mutex, NULL);
+	pthread_cond_init(&q->cond_commit, &attr);
+	pthread_cond_init(&q->cond_durable, &attr);
+
+	pthread_condattr_destroy(&attr);
+
+	q->batch = QUEUE_LOG_BATCH;
+	q->interval_ns = QUEUE_LOG_INTERVAL_US * 1000L;
+	q->idle = 0;
+	q->stop = 0;
+
+	err = pthread_create(&q->committer_tid, NULL, committer, q);
+	if (err) {
+		printf("queue_open: pthread_create() failed: %s\n", strerror(err));
+		abort();
+	}
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+
+fail_unmap:
+	munmap(q->hdr, q->map_size);
+fail_close:
+	err = errno;
+	close(q->fd);
+	errno = err;
+fail_free:
+	free(q);
+	return NULL;
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = queue_open(QUEUE_LOG_DEFAULT_PATH, max_count, QUEUE_LOG_TRUNC);
+
+	if (!q) {
+		printf("queue_init: cannot open %s: %s\n", QUEUE_LOG_DEFAULT_PATH, strerror(errno));
+		abort();
+	}
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	pthread_mutex_lock(&q->mutex);
+	q->stop = 1;
+	pthread_cond_signal(&q->cond_commit);
+	pthread_mutex_unlock(&q->mutex);
+
+	pthread_join(q->committer_tid, NULL);
+
+	munmap(q->hdr, q->map_size);
+	close(q->fd);
+
+	pthread_mutex_destroy(&q->mutex);
+	pthread_cond_destroy(&q->cond_commit);
+	pthread_cond_destroy(&q->cond_durable);
+
+	free(q);
+}
+
+// batch is clamped to [1, capacity]; interval_us 0 syncs as soon as
+// anything is pending
+void queue_set_commit(queue_t *q, int batch, long interval_us) {
+	pthread_mutex_lock(&q->mutex);
+
+	q->batch = batch < 1 ? 1 : (uint64_t)batch > q->capacity ? q->capacity : batch;
+	q->interval_ns = interval_us < 0 ? 0 : interval_us * 1000L;
+	pthread_cond_signal(&q->cond_commit);
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+uint64_t queue_durable(queue_t *q) {
+	pthread_mutex_lock(&q->mutex);
+	uint64_t n = q->durable_tail;
+	pthread_mutex_unlock(&q->mutex);
+
+	return n;
+}
+
+uint64_t queue_append(queue_t *q, int val) {
+	pthread_mutex_lock(&q->mutex);
+	q->add_attempts++;
+
+	// a slot is free once the read position past it is durable
+	if (q->tail - q->durable_head == q->capacity) {
+		commit_kick(q);
+		pthread_mutex_unlock(&q->mutex);
+		return 0;
+	}
+
+	uint64_t seq = q->tail++;
+	qlog_rec_t *r = &q->recs[seq % q->capacity];
+
+	r->val = val;
+	r->sum = rec_sum(seq, val);
+	r->seq = seq + 1;
+	q->add_count++;
+
+	commit_kick(q);
+	pthread_mutex_unlock(&q->mutex);
+
+	return seq + 1;
+}
+
+void queue_wait_durable(queue_t *q, uint64_t n) {
+	pthread_mutex_lock(&q->mutex);
+
+	while (q->durable_tail < n)
+		pthread_cond_wait(&q->cond_durable, &q->mutex);
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+int queue_add(queue_t *q, int val) {
+	return queue_append(q, val) != 0;
+}
+
+// only durable records are handed out
+int queue_get(queue_t *q, int *val) {
+	pthread_mutex_lock(&q->mutex);
+	q->get_attempts++;
+
+	if (q->head == q->durable_tail) {
+		pthread_mutex_unlock(&q->mutex);
+		return 0;
+	}
+
+	*val = q->recs[q->head % q->capacity].val;
+	q->head++;
+	q->get_count++;
+
+	commit_kick(q);
+	pthread_mutex_unlock(&q->mutex);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+
+	pthread_mutex_lock(&q->mutex);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (q->get_count - q->last_get_count) / dt : 0;
+	double syncs = dt > 0 ? (q->commits - q->last_commits) / dt : 0;
+
+	q->last_get_count = q->get_count;
+	q->last_commits = q->commits;
+	q->last_ts = now;
+
+	printf("queue stats: current size %lu (durable %lu) of %lu; attempts: (%ld %ld %ld); counts (%ld %ld %ld); recovered %lu (%lu stale dropped); "
+		"commits %ld (%.1f records, %.1fus each); durable up to %lu; %.0f ops/s %.0f commits/s\n",
+		q->tail - q->head, q->durable_tail - q->head, q->capacity,
+		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
+		q->add_count, q->get_count, q->add_count - q->get_count,
+		q->recovered, q->dropped,
+		q->commits, q->commits ? (double)q->add_count / q->commits : 0.0,
+		q->commits ? q->commit_ns / 1e3 / q->commits : 0.0,
+		q->durable_tail, ops, syncs);
+
+	pthread_mutex_unlock(&q->mutex);
+}
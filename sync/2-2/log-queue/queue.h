@@ -0,0 +1,124 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define QUEUE_LOG_MAGIC 0x474f4c51u	// "QLOG"
+#define QUEUE_LOG_PAGE 4096
+
+// queue_init() works on this file in the current directory
+#define QUEUE_LOG_DEFAULT_PATH "queue.log"
+
+// queue_open() flags
+#define QUEUE_LOG_TRUNC 1	// start empty instead of recovering
+
+// default group commit: sync every 256 records or 1ms, see queue_set_commit()
+#define QUEUE_LOG_BATCH 256
+#define QUEUE_LOG_INTERVAL_US 1000
+
+/*
+ * Durable queue: a segment file mapped into memory, used as a ring of
+ * fixed-size records. Producers append under the lock without syncing;
+ * a committer thread fdatasyncs whatever accumulated (group commit) once
+ * batch records are pending or interval_us passed, and then moves the
+ * durable watermark. Consumers only see durable records, and the read
+ * position is persisted by the same syncs, so after a restart consumers
+ * resume from the last synced read position (values read after it are
+ * delivered again).
+ *
+ * File layout: one header page, then max_count records. A record is
+ * valid for sequence number s if its seq field holds s + 1 and the
+ * checksum matches; recovery scans forward from the read position and
+ * clears whatever follows the first invalid record, so records written
+ * before a crash never reappear behind the ones written after it.
+ * Slots are only reused once the read position past them is durable.
+ */
+typedef struct _LogHeader {
+	uint32_t magic;
+	uint32_t record_size;
+	uint64_t capacity;
+	uint64_t read_seq;	// next record to read, written by the committer
+} qlog_hdr_t;
+
+typedef struct _LogRecord {
+	uint64_t seq;		// sequence number + 1, 0 if never written
+	int32_t val;
+	uint32_t sum;
+} qlog_rec_t;
+
+typedef struct _Queue {
+	int fd;
+	size_t map_size;
+	qlog_hdr_t *hdr;
+	qlog_rec_t *recs;
+	uint64_t capacity;
+
+	qmon_entry_t *mon;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_commit;	// committer waits for work
+	pthread_cond_t cond_durable;	// queue_wait_durable() waits for syncs
+
+	// records [head, tail) are in the log, [head, durable_tail) are durable
+	uint64_t head;
+	uint64_t tail;
+	uint64_t durable_tail;
+	uint64_t durable_head;
+
+	int batch;
+	long interval_ns;
+	int idle;	// committer waits for the first pending change
+	int stop;
+	pthread_t committer_tid;
+
+	// queue statistics, under the mutex
+	long add_attempts;
+	long get_attempts;
+	long add_count;
+	long get_count;
+	long commits;
+	long commit_ns;
+	uint64_t recovered;
+	uint64_t dropped;	// stale records cleared by recovery
+
+	// owned by queue_print_stats, used for the rates
+	long last_get_count;
+	long last_commits;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+// creates path or recovers the queue in it; NULL with errno on failure
+queue_t* queue_open(const char *path, int max_count, int flags);
+// stops the committer after a last sync; the file stays
+void queue_destroy(queue_t *q);
+
+// sync once batch records are pending, or interval_us after the first
+// change since the last sync
+void queue_set_commit(queue_t *q, int batch, long interval_us);
+
+// durable watermark: records with sequence numbers below it are synced
+uint64_t queue_durable(queue_t *q);
+// returns the record's sequence number + 1, the watermark at which it
+// is durable, or 0 if the log is full
+uint64_t queue_append(queue_t *q, int val);
+// blocks until queue_durable() >= n
+void queue_wait_durable(queue_t *q, uint64_t n);
+
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
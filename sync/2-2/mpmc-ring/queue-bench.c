@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Throughput benchmark for the non-blocking queue_t variants.
+ * Only the queue API is used, so the same file is linked against
+ * the ring here, the spinlock queue (2-2/a) and the mutex queue (2-2/b).
+ */
+
+#ifndef VARIANT
+#define VARIANT "queue"
+#endif
+
+#define MAX_THREADS 64
+
+static atomic_int stop;
+
+// one cache line per thread: the counters are bumped on every op and
+// must not add false sharing of their own to what is measured
+typedef struct _BenchArg {
+	_Alignas(CACHE_LINE) queue_t *q;
+	long ops;
+} bench_arg_t;
+
+void *writer(void *arg) {
+	bench_arg_t *a = (bench_arg_t *)arg;
+	int i = 0;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		if (queue_add(a->q, i)) {
+			i++;
+			a->ops++;
+		}
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	bench_arg_t *a = (bench_arg_t *)arg;
+	int val;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		if (queue_get(a->q, &val))
+			a->ops++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	pthread_t tids[2 * MAX_THREADS];
+	bench_arg_t args[2 * MAX_THREADS];
+	int producers = 1, consumers = 1, seconds = 3, max_count = 1024;
+	long adds = 0, gets = 0;
+	int err;
+
+	if (argc > 1)
+		producers = atoi(argv[1]);
+	if (argc > 2)
+		consumers = atoi(argv[2]);
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+	if (argc > 4)
+		max_count = atoi(argv[4]);
+
+	if (producers < 1 || producers > MAX_THREADS || consumers < 1 || consumers > MAX_THREADS
+			|| seconds < 1 || max_count < 1) {
+		printf("usage: %s [producers] [consumers] [seconds] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	queue_t *q = queue_init(max_count);
+
+	for (int i = 0; i < producers + consumers; i++) {
+		args[i].q = q;
+		args[i].ops = 0;
+
+		err = pthread_create(&tids[i], NULL, i < producers ? writer : reader, &args[i]);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	sleep(seconds);
+	atomic_store(&stop, 1);
+
+	for (int i = 0; i < producers + consumers; i++) {
+		pthread_join(tids[i], NULL);
+		if (i < producers)
+			adds += args[i].ops;
+		else
+			gets += args[i].ops;
+	}
+
+	printf("bench: %-6s producers %2d consumers %2d: %12.0f adds/s %12.0f gets/s\n",
+		VARIANT, producers, consumers, (double)adds / seconds, (double)gets / seconds);
+
+	queue_destroy(q);
+	return 0;
+}
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->add_count = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	s->get_count = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+	s->add_attempts = s->add_count + atomic_load_explicit(&q->add_fails, memory_order_relaxed);
+	s->get_attempts = s->get_count + atomic_load_explicit(&q->get_fails, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	size_t size = round_up_pow2(max_count);
+
+	q->cells = malloc(size * sizeof(qcell_t));
+	if (!q->cells) {
+		printf("Cannot allocate memory for queue cells\n");
+		abort();
+	}
+
+	for (size_t i = 0; i < size; i++)
+		atomic_store_explicit(&q->cells[i].seq, i, memory_order_relaxed);
+
+	q->mask = size - 1;
+	q->max_count = size;
+
+	atomic_store(&q->enqueue_pos, 0);
+	atomic_store(&q->dequeue_pos, 0);
+	atomic_store(&q->add_fails, 0);
+	atomic_store(&q->get_fails, 0);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->cells);
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	qcell_t *cell;
+	size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// the cell still holds a value from the previous lap: full
+			atomic_fetch_add_explicit(&q->add_fails, 1, memory_order_relaxed);
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+		}
+	}
+
+	cell->val = val;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	qcell_t *cell;
+	size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// nothing has been published into this cell yet: empty
+			atomic_fetch_add_explicit(&q->get_fails, 1, memory_order_relaxed);
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+		}
+	}
+
+	*val = cell->val;
+	atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	long add_count = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	long get_count = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+	long add_attempts = add_count + atomic_load_explicit(&q->add_fails, memory_order_relaxed);
+	long get_attempts = get_count + atomic_load_explicit(&q->get_fails, memory_order_relaxed);
+
+	printf("queue stats: current size %ld; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+		add_count - get_count,
+		add_attempts, get_attempts, add_attempts - get_attempts,
+		add_count, get_count, add_count - get_count);
+}
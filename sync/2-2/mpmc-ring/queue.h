@@ -0,0 +1,53 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+/*
+ * Bounded lock-free MPMC ring (D. Vyukov).
+ * Every cell carries a sequence number: seq == pos means the cell is free
+ * for the producer that claimed pos, seq == pos + 1 means it holds a value
+ * for the consumer that claimed pos.
+ */
+typedef struct _QueueCell {
+	_Atomic size_t seq;
+	int val;
+} qcell_t;
+
+typedef struct _Queue {
+	qcell_t *cells;
+	size_t mask;
+
+	qmon_entry_t *mon;
+
+	int max_count;
+
+	// producers and consumers each own a cache line
+	_Alignas(CACHE_LINE) _Atomic size_t enqueue_pos;
+	_Alignas(CACHE_LINE) _Atomic size_t dequeue_pos;
+
+	// queue statistics: successful adds/gets are the positions above,
+	// only failed attempts need their own counters
+	_Alignas(CACHE_LINE) _Atomic long add_fails;
+	_Alignas(CACHE_LINE) _Atomic long get_fails;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ebr.h"
+
+#define CACHE_LINE 64
+#define EBR_MAX_THREADS 256
+// retired pointers between two attempts to advance the global epoch
+#define EBR_ADVANCE_EVERY 64
+
+typedef struct _EbrBucket {
+	void **items;
+	int count;
+	int cap;
+} ebr_bucket_t;
+
+typedef struct _EbrRecord {
+	_Alignas(CACHE_LINE) _Atomic unsigned long epoch;
+	_Atomic int active;
+	_Atomic int used;
+
+	// only touched by the owning thread
+	ebr_bucket_t limbo[3];
+	long retired;
+} ebr_record_t;
+
+// limbo left behind by an exited thread, free once the global epoch
+// is two past the one it was orphaned in
+typedef struct _EbrOrphan {
+	struct _EbrOrphan *next;
+	unsigned long epoch;
+	ebr_bucket_t bucket;
+} ebr_orphan_t;
+
+static _Atomic unsigned long global_epoch = 0;
+static ebr_record_t records[EBR_MAX_THREADS];
+
+static pthread_mutex_t orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+static ebr_orphan_t *orphans;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static __thread ebr_record_t *self;
+
+static void bucket_free(ebr_bucket_t *b) {
+	for (int i = 0; i < b->count; i++)
+		free(b->items[i]);
+	b->count = 0;
+}
+
+static void orphans_free(unsigned long safe) {
+	ebr_orphan_t **p = &orphans, *o;
+
+	pthread_mutex_lock(&orphans_lock);
+	while ((o = *p)) {
+		if (o->epoch + 2 > safe) {
+			p = &o->next;
+			continue;
+		}
+
+		*p = o->next;
+		bucket_free(&o->bucket);
+		free(o->bucket.items);
+		free(o);
+	}
+	pthread_mutex_unlock(&orphans_lock);
+}
+
+// hands the limbo lists of r over to the orphans and gives r back
+static void record_release(ebr_record_t *r) {
+	unsigned long e = atomic_load(&global_epoch);
+
+	for (int i = 0; i < 3; i++) {
+		ebr_bucket_t *b = &r->limbo[i];
+
+		if (!b->count)
+			continue;
+
+		ebr_orphan_t *o = malloc(sizeof(ebr_orphan_t));
+		if (!o) {
+			printf("ebr: cannot allocate orphan list\n");
+			abort();
+		}
+
+		// tagged with the current epoch, not older than any item in b
+		o->epoch = e;
+		o->bucket = *b;
+		b->items = NULL;
+		b->count = b->cap = 0;
+
+		pthread_mutex_lock(&orphans_lock);
+		o->next = orphans;
+		orphans = o;
+		pthread_mutex_unlock(&orphans_lock);
+	}
+
+	atomic_store(&r->active, 0);
+	atomic_store_explicit(&r->used, 0, memory_order_release);
+}
+
+static void thread_exit(void *arg) {
+	record_release((ebr_record_t *)arg);
+}
+
+// exit() does not run key destructors for the thread calling it
+static void process_exit(void) {
+	if (self) {
+		record_release(self);
+		self = NULL;
+	}
+
+	orphans_free(atomic_load(&global_epoch));
+}
+
+static void ebr_once(void) {
+	if (pthread_key_create(&key, thread_exit)) {
+		printf("ebr: pthread_key_create() failed\n");
+		abort();
+	}
+	atexit(process_exit);
+}
+
+static ebr_record_t *ebr_self(void) {
+	if (self)
+		return self;
+
+	pthread_once(&key_once, ebr_once);
+
+	for (int i = 0; i < EBR_MAX_THREADS; i++) {
+		int unused = 0;
+		if (atomic_compare_exchange_strong(&records[i].used, &unused, 1)) {
+			self = &records[i];
+			atomic_store(&self->epoch, atomic_load(&global_epoch));
+			pthread_setspecific(key, self);
+			return self;
+		}
+	}
+
+	printf("ebr: more than %d threads\n", EBR_MAX_THREADS);
+	abort();
+}
+
+static int ebr_try_advance(void) {
+	unsigned long e = atomic_load(&global_epoch);
+
+	for (int i = 0; i < EBR_MAX_THREADS; i++) {
+		ebr_record_t *r = &records[i];
+
+		if (!atomic_load(&r->used))
+			continue;
+		if (atomic_load(&r->active) && atomic_load(&r->epoch) != e)
+			return 0;
+	}
+
+	if (!atomic_compare_exchange_strong(&global_epoch, &e, e + 1))
+		return 0;
+
+	orphans_free(e + 1);
+
+	return 1;
+}
+
+void ebr_enter(void) {
+	ebr_record_t *r = ebr_self();
+	unsigned long e = atomic_load(&global_epoch);
+
+	if (atomic_load_explicit(&r->epoch, memory_order_relaxed) != e) {
+		atomic_store(&r->epoch, e);
+		// everything retired two or more epochs ago is unreachable now
+		bucket_free(&r->limbo[(e + 1) % 3]);
+	}
+
+	atomic_store(&r->active, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+void ebr_exit(void) {
+	atomic_store_explicit(&self->active, 0, memory_order_release);
+}
+
+void ebr_retire(void *p) {
+	ebr_record_t *r = self;
+	// tag with the global epoch, not our own: a thread that entered
+	// after the global epoch moved past ours may still hold p
+	ebr_bucket_t *b = &r->limbo[atomic_load(&global_epoch) % 3];
+
+	if (b->count == b->cap) {
+		b->cap = b->cap ? 2 * b->cap : 64;
+		b->items = realloc(b->items, b->cap * sizeof(void *));
+		if (!b->items) {
+			printf("ebr: cannot allocate limbo list\n");
+			abort();
+		}
+	}
+	b->items[b->count++] = p;
+
+	if (++r->retired % EBR_ADVANCE_EVERY == 0)
+		ebr_try_advance();
+}
+
+void ebr_synchronize(void) {
+	unsigned long target = atomic_load(&global_epoch) + 2;
+
+	// sections are short, wait for the threads still in an older epoch
+	while (atomic_load(&global_epoch) < target)
+		if (!ebr_try_advance())
+			sched_yield();
+
+	if (self)
+		for (int i = 0; i < 3; i++)
+			bucket_free(&self->limbo[i]);
+
+	orphans_free(atomic_load(&global_epoch));
+}
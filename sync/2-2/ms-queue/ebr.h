@@ -0,0 +1,21 @@
+#ifndef __FITOS_EBR_H__
+#define __FITOS_EBR_H__
+
+/*
+ * Epoch-based reclamation.
+ * Shared pointers may only be dereferenced between ebr_enter() and
+ * ebr_exit(). Memory unlinked inside such a section is handed to
+ * ebr_retire() and free()d once every thread that could still see it
+ * has left its section (the global epoch moved on twice).
+ * A thread gives its record back when it exits; what it still had in
+ * limbo is freed by whoever advances the epoch twice after that.
+ */
+
+void ebr_enter(void);
+void ebr_exit(void);
+void ebr_retire(void *p);
+// waits until everything retired so far is unreachable, then frees the
+// caller's limbo and whatever exited threads left behind
+void ebr_synchronize(void);
+
+#endif		// __FITOS_EBR_H__
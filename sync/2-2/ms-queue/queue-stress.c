@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "queue.h"
+
+/*
+ * Multi-writer/multi-reader stress test derived from queue-threads.c.
+ * Writer w adds w * per_writer + 0 .. per_writer - 1 in order.
+ * Every reader checks that the values it sees from one writer grow
+ * (FIFO per producer), and at the end every value must have been
+ * read exactly once.
+ * Then churn_rounds rounds start a short-lived writer and reader pair
+ * each, so more threads than ebr has records pass through the queue
+ * over its lifetime.
+ */
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+#define MAX_THREADS 64
+
+#define CHURN_VALUES 1000
+
+static int writers = 4, readers = 4, per_writer = 1000000, churn_rounds = 300;
+
+static atomic_long total_read;
+static atomic_long order_errors;
+static atomic_char *seen;
+
+void *reader(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	int *last = malloc(writers * sizeof(int));
+	long total = (long)writers * per_writer;
+
+	if (!last) {
+		printf("reader: cannot allocate memory\n");
+		abort();
+	}
+
+	for (int w = 0; w < writers; w++)
+		last[w] = -1;
+
+	while (atomic_load_explicit(&total_read, memory_order_relaxed) < total) {
+		int val = -1;
+		int ok = queue_get(q, &val);
+		if (!ok)
+			continue;
+
+		int w = val / per_writer;
+		int seq = val % per_writer;
+
+		if (seq <= last[w]) {
+			printf(RED"ERROR: writer %d: got %d after %d" NOCOLOR "\n", w, seq, last[w]);
+			atomic_fetch_add(&order_errors, 1);
+		}
+		last[w] = seq;
+
+		atomic_fetch_add_explicit(&seen[val], 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&total_read, 1, memory_order_relaxed);
+	}
+
+	free(last);
+
+	return NULL;
+}
+
+typedef struct _WriterArg {
+	queue_t *q;
+	int id;
+} writer_arg_t;
+
+void *writer(void *arg) {
+	writer_arg_t *a = (writer_arg_t *)arg;
+	int base = a->id * per_writer;
+
+	for (int i = 0; i < per_writer; ) {
+		int ok = queue_add(a->q, base + i);
+		if (!ok)
+			continue;
+		i++;
+	}
+
+	return NULL;
+}
+
+void *churn_writer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+
+	for (int i = 0; i < CHURN_VALUES; )
+		if (queue_add(q, i))
+			i++;
+
+	return NULL;
+}
+
+void *churn_reader(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	long errors = 0;
+	int val;
+
+	for (int i = 0; i < CHURN_VALUES; ) {
+		if (!queue_get(q, &val))
+			continue;
+		if (val != i++)
+			errors++;
+	}
+
+	return (void *)errors;
+}
+
+// every round's values go through an empty queue, in order
+static long churn(queue_t *q) {
+	long errors = 0;
+
+	for (int i = 0; i < churn_rounds; i++) {
+		pthread_t w, r;
+		void *ret;
+		int err;
+
+		err = pthread_create(&w, NULL, churn_writer, q);
+		if (!err)
+			err = pthread_create(&r, NULL, churn_reader, q);
+		if (err) {
+			printf("churn: pthread_create() failed: %s\n", strerror(err));
+			abort();
+		}
+
+		pthread_join(w, NULL);
+		pthread_join(r, &ret);
+		errors += (long)ret;
+	}
+
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	pthread_t tids[2 * MAX_THREADS];
+	writer_arg_t wargs[MAX_THREADS];
+	long missing = 0, duplicates = 0;
+	int err;
+
+	if (argc > 1)
+		writers = atoi(argv[1]);
+	if (argc > 2)
+		readers = atoi(argv[2]);
+	if (argc > 3)
+		per_writer = atoi(argv[3]);
+	if (argc > 4)
+		churn_rounds = atoi(argv[4]);
+
+	if (writers < 1 || writers > MAX_THREADS || readers < 1 || readers > MAX_THREADS
+			|| per_writer < 1 || (long)writers * per_writer > 0x7fffffff || churn_rounds < 0) {
+		printf("usage: %s [writers] [readers] [values per writer] [churn rounds]\n", argv[0]);
+		return -1;
+	}
+
+	printf("main [%d %d %d]: %d writers, %d readers, %d values each\n",
+		getpid(), getppid(), gettid(), writers, readers, per_writer);
+
+	seen = calloc((long)writers * per_writer, sizeof(atomic_char));
+	if (!seen) {
+		printf("main: cannot allocate memory\n");
+		return -1;
+	}
+
+	queue_t *q = queue_init(1000000);
+
+	for (int i = 0; i < readers; i++) {
+		err = pthread_create(&tids[i], NULL, reader, q);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < writers; i++) {
+		wargs[i].q = q;
+		wargs[i].id = i;
+		err = pthread_create(&tids[readers + i], NULL, writer, &wargs[i]);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < readers + writers; i++)
+		pthread_join(tids[i], NULL);
+
+	queue_print_stats(q);
+
+	for (long i = 0; i < (long)writers * per_writer; i++) {
+		if (seen[i] == 0)
+			missing++;
+		else if (seen[i] > 1)
+			duplicates++;
+	}
+
+	printf("stress: read %ld, order errors %ld, missing %ld, duplicates %ld\n",
+		atomic_load(&total_read), atomic_load(&order_errors), missing, duplicates);
+
+	long churn_errors = churn(q);
+
+	printf("churn: %d short-lived threads, order errors %ld\n", 2 * churn_rounds, churn_errors);
+
+	queue_destroy(q);
+	free(seen);
+
+	return (order_errors || missing || duplicates || churn_errors) ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+#include "ebr.h"
+
+static qnode_t *node_new(int val) {
+	qnode_t *n = malloc(sizeof(qnode_t));
+	if (!n) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+
+	n->val = val;
+	atomic_store_explicit(&n->next, NULL, memory_order_relaxed);
+
+	return n;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->add_count = atomic_load_explicit(&q->add_count, memory_order_relaxed);
+	s->get_count = atomic_load_explicit(&q->get_count, memory_order_relaxed);
+	s->add_attempts = s->add_count + atomic_load_explicit(&q->add_fails, memory_order_relaxed);
+	s->get_attempts = s->get_count + atomic_load_explicit(&q->get_fails, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	qnode_t *dummy = node_new(0);
+	atomic_store(&q->first, dummy);
+	atomic_store(&q->last, dummy);
+	q->max_count = max_count;
+
+	atomic_store(&q->add_count, 0);
+	atomic_store(&q->add_fails, 0);
+	atomic_store(&q->get_count, 0);
+	atomic_store(&q->get_fails, 0);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+// no other thread may use the queue any more
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	// nodes the queue retired may still sit in limbo
+	ebr_synchronize();
+
+	qnode_t *current = atomic_load(&q->first);
+	while (current != NULL) {
+		qnode_t *temp = current;
+		current = atomic_load(&current->next);
+		free(temp);
+	}
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	if (q->max_count > 0 &&
+			atomic_load_explicit(&q->add_count, memory_order_relaxed) -
+			atomic_load_explicit(&q->get_count, memory_order_relaxed) >= q->max_count) {
+		atomic_fetch_add_explicit(&q->add_fails, 1, memory_order_relaxed);
+		return 0;
+	}
+
+	qnode_t *new = node_new(val);
+
+	ebr_enter();
+
+	while (1) {
+		qnode_t *last = atomic_load_explicit(&q->last, memory_order_acquire);
+		qnode_t *next = atomic_load_explicit(&last->next, memory_order_acquire);
+
+		if (last != atomic_load_explicit(&q->last, memory_order_acquire))
+			continue;
+
+		if (next == NULL) {
+			if (atomic_compare_exchange_weak_explicit(&last->next, &next, new,
+					memory_order_release, memory_order_relaxed)) {
+				atomic_compare_exchange_strong_explicit(&q->last, &last, new,
+					memory_order_release, memory_order_relaxed);
+				break;
+			}
+		} else {
+			// last is lagging behind, help the other producer
+			atomic_compare_exchange_strong_explicit(&q->last, &last, next,
+				memory_order_release, memory_order_relaxed);
+		}
+	}
+
+	ebr_exit();
+
+	atomic_fetch_add_explicit(&q->add_count, 1, memory_order_relaxed);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	qnode_t *first;
+	int v;
+
+	ebr_enter();
+
+	while (1) {
+		first = atomic_load_explicit(&q->first, memory_order_acquire);
+		qnode_t *last = atomic_load_explicit(&q->last, memory_order_acquire);
+		qnode_t *next = atomic_load_explicit(&first->next, memory_order_acquire);
+
+		if (first != atomic_load_explicit(&q->first, memory_order_acquire))
+			continue;
+
+		if (next == NULL) {
+			ebr_exit();
+			atomic_fetch_add_explicit(&q->get_fails, 1, memory_order_relaxed);
+			return 0;
+		}
+
+		if (first == last) {
+			atomic_compare_exchange_strong_explicit(&q->last, &last, next,
+				memory_order_release, memory_order_relaxed);
+			continue;
+		}
+
+		v = next->val;
+		if (atomic_compare_exchange_weak_explicit(&q->first, &first, next,
+				memory_order_acq_rel, memory_order_relaxed))
+			break;
+	}
+
+	ebr_retire(first);
+	ebr_exit();
+
+	*val = v;
+	atomic_fetch_add_explicit(&q->get_count, 1, memory_order_relaxed);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	long add_count = atomic_load_explicit(&q->add_count, memory_order_relaxed);
+	long get_count = atomic_load_explicit(&q->get_count, memory_order_relaxed);
+	long add_attempts = add_count + atomic_load_explicit(&q->add_fails, memory_order_relaxed);
+	long get_attempts = get_count + atomic_load_explicit(&q->get_fails, memory_order_relaxed);
+
+	printf("queue stats: current size %ld; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+		add_count - get_count,
+		add_attempts, get_attempts, add_attempts - get_attempts,
+		add_count, get_count, add_count - get_count);
+}
@@ -0,0 +1,50 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+typedef struct _QueueNode {
+	int val;
+	_Atomic(struct _QueueNode *) next;
+} qnode_t;
+
+/*
+ * Michael-Scott lock-free queue. first always points to a dummy node,
+ * the first value lives in first->next. Dequeued nodes are reclaimed
+ * through ebr.c, never freed directly.
+ * max_count <= 0 makes the queue unbounded; otherwise it is a soft limit
+ * checked against the counters before an add.
+ */
+typedef struct _Queue {
+	_Alignas(CACHE_LINE) _Atomic(qnode_t *) first;
+	_Alignas(CACHE_LINE) _Atomic(qnode_t *) last;
+
+	_Alignas(CACHE_LINE) qmon_entry_t *mon;
+	int max_count;
+
+	// queue statistics
+	_Alignas(CACHE_LINE) _Atomic long add_count;
+	_Atomic long add_fails;
+	_Alignas(CACHE_LINE) _Atomic long get_count;
+	_Atomic long get_fails;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * parse -> enrich -> persist over events carrying a short text record.
+ *   ring:  one 3-stage ring, every stage works on the slots in place
+ *   chain: three 1-stage rings, every stage copies the event into the
+ *          next ring, as with one queue per stage
+ * For every stage prints the events it handled, its batches and its
+ * throughput while busy (events over the time spent working rather than
+ * waiting on its barrier); persist checks every event.
+ * usage: queue-pipeline [ring|chain] [events] [ring_size] [work]
+ */
+
+#define STAGES 3
+
+typedef struct _Event {
+	long id;
+	char raw[32];
+	long parsed;
+	long enriched;
+} event_t;
+
+typedef struct _StageArg {
+	int kind;
+	queue_t *in;
+	int in_stage;
+	queue_t *out;	// chain only
+
+	long busy_ns;
+	long errors;
+	long checksum;
+} stage_arg_t;
+
+static const char *stage_names[STAGES] = { "parse", "enrich", "persist" };
+
+static long events = 2000000, work = 16;
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static long enrich(long v) {
+	for (long i = 0; i < work; i++)
+		v = v * 6364136223846793005L + 1442695040888963407L;
+
+	return v;
+}
+
+static void *claim(queue_t *q) {
+	void *slot;
+
+	while (!(slot = queue_claim(q)))
+		sched_yield();
+
+	return slot;
+}
+
+void *producer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+
+	for (long i = 0; i < events; i++) {
+		event_t *e = claim(q);
+
+		e->id = i;
+		snprintf(e->raw, sizeof(e->raw), "id=%ld", i * 7);
+		queue_publish(q);
+	}
+
+	return NULL;
+}
+
+static void process(stage_arg_t *a, event_t *e) {
+	switch (a->kind) {
+	case 0:
+		e->parsed = strtol(e->raw + 3, NULL, 10);
+		break;
+	case 1:
+		e->enriched = enrich(e->parsed);
+		break;
+	default:
+		if (e->parsed != e->id * 7 || e->enriched != enrich(e->parsed))
+			a->errors++;
+		a->checksum += e->enriched;
+	}
+}
+
+void *stage(void *arg) {
+	stage_arg_t *a = (stage_arg_t *)arg;
+
+	for (long next = 0; next < events; ) {
+		long avail = queue_stage_wait(a->in, a->in_stage, next);
+		long start = now_ns();
+
+		for (long seq = next; seq <= avail; seq++) {
+			event_t *e = queue_slot(a->in, seq);
+
+			process(a, e);
+			if (a->out) {
+				memcpy(claim(a->out), e, sizeof(event_t));
+				queue_publish(a->out);
+			}
+		}
+
+		queue_stage_done(a->in, a->in_stage, avail);
+		a->busy_ns += now_ns() - start;
+		next = avail + 1;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	const char *mode = argc > 1 ? argv[1] : "ring";
+	int size = 1024;
+	pthread_t tids[STAGES + 1];
+	stage_arg_t args[STAGES];
+	queue_t *rings[STAGES];
+	int err;
+
+	if (argc > 2)
+		events = atol(argv[2]);
+	if (argc > 3)
+		size = atoi(argv[3]);
+	if (argc > 4)
+		work = atol(argv[4]);
+
+	int chain = !strcmp(mode, "chain");
+
+	if ((!chain && strcmp(mode, "ring")) || events < 1 || size < 1 || work < 0) {
+		printf("usage: %s [ring|chain] [events] [ring_size] [work]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	for (int i = 0; i < STAGES; i++) {
+		if (chain)
+			rings[i] = queue_init_pipeline(size, sizeof(event_t), 1);
+		else
+			rings[i] = i ? rings[0] : queue_init_pipeline(size, sizeof(event_t), STAGES);
+	}
+
+	long start = now_ns();
+
+	for (int i = 0; i < STAGES; i++) {
+		memset(&args[i], 0, sizeof(args[i]));
+		args[i].kind = i;
+		args[i].in = rings[i];
+		args[i].in_stage = chain ? 0 : i;
+		args[i].out = chain && i + 1 < STAGES ? rings[i + 1] : NULL;
+
+		err = pthread_create(&tids[i], NULL, stage, &args[i]);
+		if (err) {
+			printf("main: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	err = pthread_create(&tids[STAGES], NULL, producer, rings[0]);
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	for (int i = 0; i <= STAGES; i++)
+		pthread_join(tids[i], NULL);
+
+	double secs = (now_ns() - start) / 1e9;
+
+	printf("pipeline: %-5s events %ld size %d work %ld: %10.0f events/s end to end%s\n",
+		mode, events, size, work, events / secs, args[STAGES - 1].errors ? " ERROR" : "");
+
+	for (int i = 0; i < STAGES; i++) {
+		qstage_t *st = &args[i].in->stage[args[i].in_stage];
+
+		printf("  stage %-7s: %ld events in %8ld batches (%6.1f per batch); %10.0f events/s busy (%.0f%% busy)\n",
+			stage_names[i], st->events, st->batches, (double)st->events / st->batches,
+			st->events / (args[i].busy_ns / 1e9), 100 * args[i].busy_ns / 1e9 / secs);
+	}
+
+	for (int i = 0; i < STAGES; i++)
+		if (chain || !i)
+			queue_destroy(rings[i]);
+
+	return args[STAGES - 1].errors != 0;
+}
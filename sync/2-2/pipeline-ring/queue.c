@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+static _Atomic long *stage_barrier(queue_t *q, int stage) {
+	return stage ? &q->stage[stage - 1].seq : &q->cursor;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+	long done = atomic_load_explicit(&q->stage[q->stages - 1].seq, memory_order_relaxed) + 1;
+
+	s->add_attempts = q->add_attempts;
+	s->add_count = atomic_load_explicit(&q->cursor, memory_order_relaxed) + 1;
+	s->get_attempts = q->get_attempts;
+	s->get_count = done;
+	s->count = s->add_count - done;
+}
+
+queue_t* queue_init(int max_count) {
+	return queue_init_pipeline(max_count, sizeof(int), 1);
+}
+
+queue_t* queue_init_pipeline(int max_count, size_t slot_size, int stages) {
+	assert(max_count > 0 && slot_size > 0);
+	assert(stages > 0 && stages <= QUEUE_MAX_STAGES);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->size = round_up_pow2(max_count);
+	q->mask = q->size - 1;
+	q->slot_size = slot_size;
+	q->stages = stages;
+
+	q->slots = aligned_alloc(CACHE_LINE, (q->size * slot_size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+	if (!q->slots) {
+		printf("Cannot allocate memory for queue slots\n");
+		abort();
+	}
+
+	atomic_store(&q->cursor, -1);
+	q->next = 0;
+	q->gate_cache = -1;
+	q->add_attempts = q->add_count = q->get_attempts = 0;
+
+	for (int i = 0; i < stages; i++) {
+		atomic_store(&q->stage[i].seq, -1);
+		q->stage[i].barrier_cache = -1;
+		q->stage[i].batches = q->stage[i].events = 0;
+	}
+
+	q->last_get_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->slots);
+	free(q);
+}
+
+void *queue_claim(queue_t *q) {
+	long wrap = q->next - q->size;
+
+	q->add_attempts++;
+
+	// the slot was last used by sequence wrap
+	if (wrap > q->gate_cache) {
+		q->gate_cache = atomic_load_explicit(&q->stage[q->stages - 1].seq, memory_order_acquire);
+		if (wrap > q->gate_cache)
+			return NULL;
+	}
+
+	return queue_slot(q, q->next);
+}
+
+void queue_publish(queue_t *q) {
+	atomic_store_explicit(&q->cursor, q->next, memory_order_release);
+	q->next++;
+	q->add_count++;
+}
+
+long queue_stage_poll(queue_t *q, int stage, long next) {
+	qstage_t *s = &q->stage[stage];
+
+	if (s->barrier_cache < next)
+		s->barrier_cache = atomic_load_explicit(stage_barrier(q, stage), memory_order_acquire);
+
+	return s->barrier_cache;
+}
+
+long queue_stage_wait(queue_t *q, int stage, long next) {
+	long avail;
+	int spins = 0;
+
+	while ((avail = queue_stage_poll(q, stage, next)) < next) {
+		if (++spins == QUEUE_SPIN) {
+			sched_yield();
+			spins = 0;
+		}
+	}
+
+	return avail;
+}
+
+void queue_stage_done(queue_t *q, int stage, long seq) {
+	qstage_t *s = &q->stage[stage];
+
+	s->batches++;
+	s->events += seq - atomic_load_explicit(&s->seq, memory_order_relaxed);
+	atomic_store_explicit(&s->seq, seq, memory_order_release);
+}
+
+int queue_add(queue_t *q, int val) {
+	int *slot = queue_claim(q);
+
+	if (!slot)
+		return 0;
+
+	*slot = val;
+	queue_publish(q);
+
+	return 1;
+}
+
+// takes one value from the last stage's position; earlier stages, if
+// any, are run by their own threads
+int queue_get(queue_t *q, int *val) {
+	int last = q->stages - 1;
+	long next = atomic_load_explicit(&q->stage[last].seq, memory_order_relaxed) + 1;
+
+	q->get_attempts++;
+	if (queue_stage_poll(q, last, next) < next)
+		return 0;
+
+	*val = *(int *)queue_slot(q, next);
+	queue_stage_done(q, last, next);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+	qmon_sample_t s;
+
+	queue_sample(q, &s);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (s.get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = s.get_count;
+	q->last_ts = now;
+
+	printf("queue stats: current size %ld of %ld; attempts: (%ld %ld %ld); counts (%ld %ld %ld); %.0f ops/s\n",
+		s.count, q->size,
+		s.add_attempts, s.get_attempts, s.add_attempts - s.get_attempts,
+		s.add_count, s.get_count, s.add_count - s.get_count, ops);
+
+	for (int i = 0; i < q->stages; i++) {
+		qstage_t *st = &q->stage[i];
+
+		printf("  stage %d: at %ld; %ld events in %ld batches (%.1f per batch)\n",
+			i, atomic_load_explicit(&st->seq, memory_order_relaxed), st->events, st->batches,
+			st->batches ? (double)st->events / st->batches : 0.0);
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+#define QUEUE_MAX_STAGES 8
+// barrier polls before yielding the CPU
+#define QUEUE_SPIN 128
+
+/*
+ * Disruptor-style pipeline ring: one preallocated ring of fixed-size
+ * slots, one producer and a chain of consumer stages that all work on the
+ * slots in place. Sequences count from 0, every stage publishes the last
+ * sequence it is done with:
+ *   - the producer publishes into cursor, and may only reuse a slot once
+ *     the last stage is done with the lap before;
+ *   - stage 0 gates on cursor, stage i on stage i - 1 (its barrier).
+ * A stage that fell behind takes everything its barrier allows in one
+ * batch and publishes its sequence once at the end, so the stages after
+ * it and the producer catch up with one store.
+ *
+ *   producer: e = queue_claim(q); fill e; queue_publish(q);
+ *   stage s:  avail = queue_stage_wait(q, s, next);
+ *             for seq in next..avail: work on queue_slot(q, seq);
+ *             queue_stage_done(q, s, avail); next = avail + 1;
+ *
+ * queue_add/queue_get move an int through a ring whose last stage is the
+ * consumer; queue_init() builds a single-stage one.
+ */
+typedef struct _QueueStage {
+	_Alignas(CACHE_LINE) _Atomic long seq;	// last sequence done with
+
+	// owned by the stage's thread
+	long barrier_cache;
+	long batches;
+	long events;
+} qstage_t;
+
+typedef struct _Queue {
+	unsigned char *slots;
+	size_t slot_size;
+	long size;
+	long mask;
+	int stages;
+
+	qmon_entry_t *mon;
+
+	// producer side
+	_Alignas(CACHE_LINE) _Atomic long cursor;	// last published sequence
+	long next;
+	long gate_cache;
+	long add_attempts;
+	long add_count;
+
+	qstage_t stage[QUEUE_MAX_STAGES];
+
+	// queue_get() callers
+	_Alignas(CACHE_LINE) long get_attempts;
+
+	// owned by queue_print_stats, used for the rate
+	_Alignas(CACHE_LINE) long last_get_count;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+queue_t* queue_init_pipeline(int max_count, size_t slot_size, int stages);
+void queue_destroy(queue_t *q);
+
+// producer; NULL if the slot is still used by the last stage
+void *queue_claim(queue_t *q);
+void queue_publish(queue_t *q);
+
+static inline void *queue_slot(queue_t *q, long seq) {
+	return q->slots + (seq & q->mask) * q->slot_size;
+}
+
+// highest sequence stage may work on; queue_stage_poll may return less
+// than next, queue_stage_wait spins (and yields) until it is >= next
+long queue_stage_poll(queue_t *q, int stage, long next);
+long queue_stage_wait(queue_t *q, int stage, long next);
+void queue_stage_done(queue_t *q, int stage, long seq);
+
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
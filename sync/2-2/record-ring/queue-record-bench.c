@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * Record throughput: int-only queue_add/queue_get against 64 B and 1 KiB
+ * records, moved either by copy (queue_add_record/queue_get_record from a
+ * caller buffer) or in place (reserve/commit, peek/release).
+ * Producers fill the whole record, consumers check its first and last byte.
+ */
+
+#define MAX_THREADS 64
+#define MAX_RECORD 4096
+
+enum { MODE_INT, MODE_COPY, MODE_INPLACE };
+
+static const char *mode_names[] = { "int", "copy", "inplace" };
+
+static atomic_int stop;
+static atomic_long bad_records;
+
+// one cache line per thread, ops is bumped on every record
+typedef struct _BenchArg {
+	_Alignas(CACHE_LINE) queue_t *q;
+	int mode;
+	size_t size;
+	long ops;
+} bench_arg_t;
+
+static void fill(unsigned char *rec, size_t size, long i) {
+	memset(rec, i & 0xff, size);
+}
+
+static void check(const unsigned char *rec, size_t size) {
+	if (rec[0] != rec[size - 1])
+		atomic_fetch_add_explicit(&bad_records, 1, memory_order_relaxed);
+}
+
+void *writer(void *arg) {
+	bench_arg_t *a = (bench_arg_t *)arg;
+	unsigned char buf[MAX_RECORD];
+	long i = 0;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		int ok;
+
+		if (a->mode == MODE_INT) {
+			ok = queue_add(a->q, i);
+		} else if (a->mode == MODE_COPY) {
+			fill(buf, a->size, i);
+			ok = queue_add_record(a->q, buf);
+		} else {
+			unsigned char *rec = queue_reserve(a->q);
+			if ((ok = rec != NULL)) {
+				fill(rec, a->size, i);
+				queue_commit(a->q, rec);
+			}
+		}
+
+		if (ok) {
+			i++;
+			a->ops++;
+		}
+	}
+
+	return NULL;
+}
+
+void *reader(void *arg) {
+	bench_arg_t *a = (bench_arg_t *)arg;
+	unsigned char buf[MAX_RECORD];
+	int val;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		int ok;
+
+		if (a->mode == MODE_INT) {
+			ok = queue_get(a->q, &val);
+		} else if (a->mode == MODE_COPY) {
+			if ((ok = queue_get_record(a->q, buf)))
+				check(buf, a->size);
+		} else {
+			unsigned char *rec = queue_peek(a->q);
+			if ((ok = rec != NULL)) {
+				check(rec, a->size);
+				queue_release(a->q, rec);
+			}
+		}
+
+		if (ok)
+			a->ops++;
+	}
+
+	return NULL;
+}
+
+static int run(int mode, size_t size, int producers, int consumers, int seconds, int max_count) {
+	pthread_t tids[2 * MAX_THREADS];
+	bench_arg_t args[2 * MAX_THREADS];
+	long gets = 0;
+	int err;
+
+	queue_t *q = queue_init_records(max_count, size);
+
+	atomic_store(&stop, 0);
+
+	for (int i = 0; i < producers + consumers; i++) {
+		args[i].q = q;
+		args[i].mode = mode;
+		args[i].size = size;
+		args[i].ops = 0;
+
+		err = pthread_create(&tids[i], NULL, i < producers ? writer : reader, &args[i]);
+		if (err) {
+			printf("run: pthread_create() failed: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	sleep(seconds);
+	atomic_store(&stop, 1);
+
+	for (int i = 0; i < producers + consumers; i++) {
+		pthread_join(tids[i], NULL);
+		if (i >= producers)
+			gets += args[i].ops;
+	}
+
+	printf("bench: %-7s record %4zu slot %4zu: %12.0f msgs/s %10.1f MB/s\n",
+		mode_names[mode], size, q->slot_size,
+		(double)gets / seconds, (double)gets * size / seconds / 1e6);
+
+	queue_destroy(q);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int producers = 1, consumers = 1, seconds = 3, max_count = 1024;
+	size_t sizes[] = { 64, 1024 };
+
+	if (argc > 1)
+		producers = atoi(argv[1]);
+	if (argc > 2)
+		consumers = atoi(argv[2]);
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+	if (argc > 4)
+		max_count = atoi(argv[4]);
+
+	if (producers < 1 || producers > MAX_THREADS || consumers < 1 || consumers > MAX_THREADS
+			|| seconds < 1 || max_count < 1) {
+		printf("usage: %s [producers] [consumers] [seconds] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	if (run(MODE_INT, sizeof(int), producers, consumers, seconds, max_count))
+		return -1;
+
+	for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		if (run(MODE_COPY, sizes[s], producers, consumers, seconds, max_count))
+			return -1;
+		if (run(MODE_INPLACE, sizes[s], producers, consumers, seconds, max_count))
+			return -1;
+	}
+
+	if (atomic_load(&bad_records)) {
+		printf("ERROR: %ld torn records\n", atomic_load(&bad_records));
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+static inline qslot_t *slot_at(queue_t *q, size_t pos) {
+	return (qslot_t *)(q->slots + (pos & q->mask) * q->slot_size);
+}
+
+static inline qslot_t *slot_of(void *rec) {
+	return (qslot_t *)((unsigned char *)rec - offsetof(qslot_t, data));
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->add_count = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	s->get_count = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+	s->add_attempts = s->add_count + atomic_load_explicit(&q->add_fails, memory_order_relaxed);
+	s->get_attempts = s->get_count + atomic_load_explicit(&q->get_fails, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	return queue_init_records(max_count, sizeof(int));
+}
+
+queue_t* queue_init_records(int max_count, size_t record_size) {
+	assert(max_count > 0 && record_size > 0);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	size_t size = round_up_pow2(max_count);
+	size_t align = _Alignof(qslot_t);
+
+	q->record_size = record_size;
+	q->slot_size = (sizeof(qslot_t) + record_size + align - 1) & ~(align - 1);
+
+	q->slots = aligned_alloc(CACHE_LINE, size * q->slot_size);
+	if (!q->slots) {
+		printf("Cannot allocate memory for queue slots\n");
+		abort();
+	}
+
+	q->mask = size - 1;
+	q->max_count = size;
+
+	for (size_t i = 0; i < size; i++)
+		atomic_store_explicit(&slot_at(q, i)->seq, i, memory_order_relaxed);
+
+	atomic_store(&q->enqueue_pos, 0);
+	atomic_store(&q->dequeue_pos, 0);
+	atomic_store(&q->add_fails, 0);
+	atomic_store(&q->get_fails, 0);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->slots);
+	free(q);
+}
+
+void *queue_reserve(queue_t *q) {
+	qslot_t *slot;
+	size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+	while (1) {
+		slot = slot_at(q, pos);
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				return slot->data;
+		} else if (diff < 0) {
+			// the slot still holds a record from the previous lap: full
+			atomic_fetch_add_explicit(&q->add_fails, 1, memory_order_relaxed);
+			return NULL;
+		} else {
+			pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+		}
+	}
+}
+
+void queue_commit(queue_t *q, void *rec) {
+	qslot_t *slot = slot_of(rec);
+
+	// nobody else writes seq while the producer owns the slot
+	size_t pos = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+void *queue_peek(queue_t *q) {
+	qslot_t *slot;
+	size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+	while (1) {
+		slot = slot_at(q, pos);
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				return slot->data;
+		} else if (diff < 0) {
+			// nothing has been committed into this slot yet: empty
+			atomic_fetch_add_explicit(&q->get_fails, 1, memory_order_relaxed);
+			return NULL;
+		} else {
+			pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+		}
+	}
+}
+
+void queue_release(queue_t *q, void *rec) {
+	qslot_t *slot = slot_of(rec);
+
+	// seq is pos + 1 until the slot is handed back for the next lap
+	size_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, seq + q->mask, memory_order_release);
+}
+
+int queue_add_record(queue_t *q, const void *rec) {
+	void *dst = queue_reserve(q);
+
+	if (!dst)
+		return 0;
+
+	memcpy(dst, rec, q->record_size);
+	queue_commit(q, dst);
+
+	return 1;
+}
+
+int queue_get_record(queue_t *q, void *rec) {
+	void *src = queue_peek(q);
+
+	if (!src)
+		return 0;
+
+	memcpy(rec, src, q->record_size);
+	queue_release(q, src);
+
+	return 1;
+}
+
+int queue_add(queue_t *q, int val) {
+	assert(q->record_size >= sizeof(int));
+
+	int *rec = queue_reserve(q);
+
+	if (!rec)
+		return 0;
+
+	*rec = val;
+	queue_commit(q, rec);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	assert(q->record_size >= sizeof(int));
+
+	int *rec = queue_peek(q);
+
+	if (!rec)
+		return 0;
+
+	*val = *rec;
+	queue_release(q, rec);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	qmon_sample_t s;
+
+	queue_sample(q, &s);
+
+	printf("queue stats: current size %ld; attempts: (%ld %ld %ld); counts (%ld %ld %ld); record %zu slot %zu\n",
+		s.count,
+		s.add_attempts, s.get_attempts, s.add_attempts - s.get_attempts,
+		s.add_count, s.get_count, s.add_count - s.get_count,
+		q->record_size, q->slot_size);
+}
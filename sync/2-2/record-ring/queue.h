@@ -0,0 +1,72 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+/*
+ * Bounded lock-free MPMC ring of fixed-size records (D. Vyukov's
+ * sequence-numbered cells, as in ../mpmc-ring).
+ * The records live inline in the slots, so a message is written and read
+ * in place and never copied:
+ *
+ *   producer: rec = queue_reserve(q); fill rec; queue_commit(q, rec);
+ *   consumer: rec = queue_peek(q); use rec; queue_release(q, rec);
+ *
+ * Between reserve and commit (peek and release) the slot belongs to the
+ * caller; later slots are not visible to consumers (producers) until it
+ * is handed over. queue_add/queue_get copy an int through the same slots.
+ */
+typedef struct _QueueSlot {
+	// pos: free for producer pos, pos + 1: holds a record for consumer pos
+	_Atomic size_t seq;
+	_Alignas(16) unsigned char data[];
+} qslot_t;
+
+typedef struct _Queue {
+	unsigned char *slots;
+	size_t slot_size;
+	size_t record_size;
+	size_t mask;
+
+	qmon_entry_t *mon;
+
+	int max_count;
+
+	// producers and consumers each own a cache line
+	_Alignas(CACHE_LINE) _Atomic size_t enqueue_pos;
+	_Alignas(CACHE_LINE) _Atomic size_t dequeue_pos;
+
+	// queue statistics: successful adds/gets are the positions above,
+	// only failed attempts need their own counters
+	_Alignas(CACHE_LINE) _Atomic long add_fails;
+	_Alignas(CACHE_LINE) _Atomic long get_fails;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+queue_t* queue_init_records(int max_count, size_t record_size);
+void queue_destroy(queue_t *q);
+
+void *queue_reserve(queue_t *q);
+void queue_commit(queue_t *q, void *rec);
+void *queue_peek(queue_t *q);
+void queue_release(queue_t *q, void *rec);
+
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+int queue_add_record(queue_t *q, const void *rec);
+int queue_get_record(queue_t *q, void *rec);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
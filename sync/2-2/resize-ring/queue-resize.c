@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+/*
+ * Bursty producer, steady consumer: the producer adds BURST values as
+ * fast as it can, then sleeps PAUSE_US; the consumer takes whatever is
+ * there and checks the order.
+ *   fixed:  a ring of min, the producer spins on full during bursts
+ *   auto:   autosize between min and max
+ *   stress: a ring of min and a third thread asking for a random size
+ *           between min and max every RESIZE_US
+ * Prints the queue stats every second, then adds that failed on full,
+ * resize events and memory.
+ * usage: queue-resize [fixed|auto|stress] [seconds] [min] [max]
+ */
+
+#define BURST 100000
+#define PAUSE_US 20000
+#define RESIZE_US 100
+
+static _Atomic int stop;
+
+void *producer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	int i = 0;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		// the consumer is gone once stop is set, a full ring stays full
+		for (int n = 0; n < BURST; ) {
+			if (queue_add(q, i)) {
+				i++;
+				n++;
+			} else if (atomic_load_explicit(&stop, memory_order_relaxed)) {
+				return NULL;
+			} else {
+				sched_yield();
+			}
+		}
+
+		usleep(PAUSE_US);
+	}
+
+	return NULL;
+}
+
+void *consumer(void *arg) {
+	queue_t *q = (queue_t *)arg;
+	long errors = 0;
+	int expected = 0;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		int val;
+
+		if (!queue_get(q, &val)) {
+			sched_yield();
+			continue;
+		}
+
+		if (val != expected && !errors++)
+			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+		expected = val + 1;
+	}
+
+	return (void *)errors;
+}
+
+typedef struct _ResizerArg {
+	queue_t *q;
+	int min;
+	int max;
+} resizer_arg_t;
+
+void *resizer(void *arg) {
+	resizer_arg_t *a = (resizer_arg_t *)arg;
+	unsigned int seed = 1;
+
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		queue_resize(a->q, a->min + rand_r(&seed) % (a->max - a->min + 1));
+		usleep(RESIZE_US);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	const char *mode = argc > 1 ? argv[1] : "auto";
+	int seconds = 3, min = 1024, max = 262144;
+	pthread_t tids[3];
+	resizer_arg_t ra;
+	struct timespec start, end;
+	void *errors;
+	int err;
+
+	if (argc > 2)
+		seconds = atoi(argv[2]);
+	if (argc > 3)
+		min = atoi(argv[3]);
+	if (argc > 4)
+		max = atoi(argv[4]);
+
+	int fixed = !strcmp(mode, "fixed"), autosize = !strcmp(mode, "auto"), stress = !strcmp(mode, "stress");
+
+	if (!(fixed || autosize || stress) || seconds < 1 || min < 1 || max < min) {
+		printf("usage: %s [fixed|auto|stress] [seconds] [min] [max]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	queue_t *q = queue_init(min);
+	if (autosize)
+		queue_set_autosize(q, min, max);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	err = pthread_create(&tids[0], NULL, consumer, q);
+	if (!err)
+		err = pthread_create(&tids[1], NULL, producer, q);
+	if (!err && stress) {
+		ra.q = q;
+		ra.min = min;
+		ra.max = max;
+		err = pthread_create(&tids[2], NULL, resizer, &ra);
+	}
+	if (err) {
+		printf("main: pthread_create() failed: %s\n", strerror(err));
+		return -1;
+	}
+
+	for (int i = 0; i < seconds; i++) {
+		sleep(1);
+		queue_print_stats(q);
+	}
+
+	atomic_store(&stop, 1);
+	pthread_join(tids[1], NULL);
+	pthread_join(tids[0], &errors);
+	if (stress)
+		pthread_join(tids[2], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	long adds = atomic_load(&q->tail);
+	long failed = atomic_load(&q->add_attempts) - adds;
+
+	printf("resize: %-6s min %d max %d: %10.0f adds/s, %9ld failed adds; %ld grows %ld shrinks; "
+		"capacity now %zu, mem now %ld KB peak %ld KB%s\n",
+		mode, min, max, adds / secs, failed,
+		atomic_load(&q->grows), atomic_load(&q->shrinks),
+		queue_capacity(q), queue_mem(q) / 1024, atomic_load(&q->mem_peak) / 1024,
+		errors ? " ERROR" : "");
+
+	queue_destroy(q);
+
+	return errors != NULL;
+}
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+// single-writer counter: no RMW needed, the monitor only reads it
+static inline void stat_inc(_Atomic long *c) {
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+		memory_order_relaxed);
+}
+
+static qring_t *ring_alloc(queue_t *q, size_t size, size_t start) {
+	size_t bytes = (sizeof(qring_t) + size * sizeof(int) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+
+	qring_t *r = aligned_alloc(CACHE_LINE, bytes);
+	if (!r) {
+		printf("Cannot allocate memory for queue ring\n");
+		abort();
+	}
+
+	atomic_store_explicit(&r->next, NULL, memory_order_relaxed);
+	r->start = r->end = start;
+	r->mask = size - 1;
+	r->bytes = bytes;
+
+	// producer and consumer both account, so these are real RMWs
+	long mem = atomic_fetch_add(&q->mem_bytes, bytes) + bytes;
+	if (mem > atomic_load_explicit(&q->mem_peak, memory_order_relaxed))
+		atomic_store_explicit(&q->mem_peak, mem, memory_order_relaxed);
+	atomic_fetch_add(&q->rings, 1);
+
+	return r;
+}
+
+static void ring_free(queue_t *q, qring_t *r) {
+	atomic_fetch_sub(&q->mem_bytes, r->bytes);
+	atomic_fetch_sub(&q->rings, 1);
+	free(r);
+}
+
+// producer: positions from tail on go to a new ring of size slots
+static void ring_switch(queue_t *q, size_t size, size_t tail) {
+	qring_t *r = q->prod;
+	qring_t *n = ring_alloc(q, size, tail);
+
+	r->end = tail;
+	atomic_store_explicit(&r->next, n, memory_order_release);
+	q->prod = n;
+	q->low_laps = 0;
+
+	atomic_store_explicit(&q->capacity, size, memory_order_relaxed);
+	stat_inc(size > r->mask + 1 ? &q->grows : &q->shrinks);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->get_count = atomic_load_explicit(&q->head, memory_order_relaxed);
+	s->add_count = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	s->add_attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+	s->get_attempts = atomic_load_explicit(&q->get_attempts, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	size_t size = round_up_pow2(max_count);
+
+	q->min_size = q->max_size = 0;
+	atomic_store(&q->want, 0);
+	atomic_store(&q->capacity, size);
+	atomic_store(&q->mem_bytes, 0);
+	atomic_store(&q->mem_peak, 0);
+	atomic_store(&q->rings, 0);
+
+	atomic_store(&q->tail, 0);
+	atomic_store(&q->head, 0);
+	q->head_cache = q->tail_cache = 0;
+	q->low_laps = 0;
+
+	q->prod = q->cons = ring_alloc(q, size, 0);
+
+	atomic_store(&q->add_attempts, 0);
+	atomic_store(&q->get_attempts, 0);
+	atomic_store(&q->grows, 0);
+	atomic_store(&q->shrinks, 0);
+	atomic_store(&q->retired, 0);
+
+	q->last_get_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	qring_t *r = q->cons;
+	while (r) {
+		qring_t *next = atomic_load(&r->next);
+		ring_free(q, r);
+		r = next;
+	}
+
+	free(q);
+}
+
+void queue_resize(queue_t *q, int max_count) {
+	assert(max_count > 0);
+
+	atomic_store_explicit(&q->want, round_up_pow2(max_count), memory_order_relaxed);
+}
+
+void queue_set_autosize(queue_t *q, int min_count, int max_count) {
+	assert(min_count >= 0 && max_count >= min_count);
+
+	q->min_size = min_count ? round_up_pow2(min_count) : 0;
+	q->max_size = max_count ? round_up_pow2(max_count) : 0;
+}
+
+size_t queue_capacity(queue_t *q) {
+	return atomic_load_explicit(&q->capacity, memory_order_relaxed);
+}
+
+long queue_mem(queue_t *q) {
+	return atomic_load_explicit(&q->mem_bytes, memory_order_relaxed);
+}
+
+int queue_add(queue_t *q, int val) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	qring_t *r = q->prod;
+
+	stat_inc(&q->add_attempts);
+
+	if (atomic_load_explicit(&q->want, memory_order_relaxed)) {
+		size_t want = atomic_exchange_explicit(&q->want, 0, memory_order_relaxed);
+
+		if (want && want != r->mask + 1) {
+			ring_switch(q, want, tail);
+			r = q->prod;
+		}
+	}
+
+	if (tail - q->head_cache > r->mask) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+
+		while (tail - q->head_cache > r->mask) {
+			if (r->mask + 1 >= q->max_size)
+				return 0;
+
+			ring_switch(q, (r->mask + 1) * 2, tail);
+			r = q->prod;
+		}
+	} else if (q->min_size && (tail & r->mask) == 0 && tail != r->start &&
+			r->mask + 1 > q->min_size) {
+		// a lap done, give memory back once QUEUE_SHRINK_LAPS laps in a
+		// row ended with the ring mostly unused
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->head_cache >= (r->mask + 1) / 4)
+			q->low_laps = 0;
+		else if (++q->low_laps == QUEUE_SHRINK_LAPS) {
+			ring_switch(q, (r->mask + 1) / 2, tail);
+			r = q->prod;
+		}
+	}
+
+	r->buf[tail & r->mask] = val;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	qring_t *r = q->cons, *next;
+
+	stat_inc(&q->get_attempts);
+
+	if (head == q->tail_cache) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_cache)
+			return 0;
+	}
+
+	// the producer linked next before publishing anything past r's end,
+	// which is only valid once next is seen
+	while ((next = atomic_load_explicit(&r->next, memory_order_acquire)) && head == r->end) {
+		q->cons = next;
+		ring_free(q, r);
+		stat_inc(&q->retired);
+		r = next;
+	}
+
+	*val = r->buf[head & r->mask];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+	qmon_sample_t s;
+
+	queue_sample(q, &s);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (s.get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = s.get_count;
+	q->last_ts = now;
+
+	printf("queue stats: current size %ld of %zu; attempts: (%ld %ld %ld); counts (%ld %ld %ld); %.0f ops/s; "
+		"mem %ld KB in %ld rings (peak %ld KB); resizes: %ld grow %ld shrink, %ld retired\n",
+		s.count, queue_capacity(q),
+		s.add_attempts, s.get_attempts, s.add_attempts - s.get_attempts,
+		s.add_count, s.get_count, s.add_count - s.get_count, ops,
+		queue_mem(q) / 1024, atomic_load_explicit(&q->rings, memory_order_relaxed),
+		atomic_load_explicit(&q->mem_peak, memory_order_relaxed) / 1024,
+		atomic_load_explicit(&q->grows, memory_order_relaxed),
+		atomic_load_explicit(&q->shrinks, memory_order_relaxed),
+		atomic_load_explicit(&q->retired, memory_order_relaxed));
+}
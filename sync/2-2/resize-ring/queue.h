@@ -0,0 +1,103 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+// laps in a row ending less than a quarter full before autosize halves the ring
+#define QUEUE_SHRINK_LAPS 4
+
+/*
+ * Single-producer/single-consumer ring that changes its capacity while
+ * both sides run. head and tail are positions over the whole life of the
+ * queue; a ring holds the positions from its start on, in slot
+ * pos & mask, until the producer moves to a new ring.
+ *
+ * Resizing is done by the producer, at its next queue_add: it ends the
+ * current ring at tail, links the new one (starting at tail) behind it
+ * and adds there from then on. The consumer drains the old ring up to
+ * its end, follows the link and frees the old ring: the producer never
+ * touches a ring again after linking the next one, so the consumer is
+ * its last user. Nothing stops either side; the bound is checked on
+ * tail - head against the producer's ring, so after a shrink adds fail
+ * until the consumer is down below the new capacity.
+ *
+ * Resizes come from queue_resize() (any thread) or from the autosize
+ * bounds: the producer doubles the ring instead of failing an add, and
+ * halves it after QUEUE_SHRINK_LAPS laps that ended with it less than a
+ * quarter full.
+ */
+typedef struct _QueueRing {
+	_Atomic(struct _QueueRing *) next;	// set once the producer moved on
+	size_t start;	// first position in this ring
+	size_t end;	// first position past it, valid once next is set
+	size_t mask;
+	size_t bytes;
+	int buf[];
+} qring_t;
+
+typedef struct _Queue {
+	qmon_entry_t *mon;
+
+	// autosize bounds, 0 when off
+	size_t min_size;
+	size_t max_size;
+
+	_Atomic size_t want;	// queue_resize() request, 0 if none
+
+	_Atomic size_t capacity;
+	_Atomic long mem_bytes;	// rings not freed yet
+	_Atomic long mem_peak;
+	_Atomic long rings;
+
+	// written by the producer only
+	_Alignas(CACHE_LINE) _Atomic size_t tail;
+	qring_t *prod;
+	size_t head_cache;
+	int low_laps;
+	_Atomic long add_attempts;
+	_Atomic long grows;
+	_Atomic long shrinks;
+
+	// written by the consumer only
+	_Alignas(CACHE_LINE) _Atomic size_t head;
+	qring_t *cons;
+	size_t tail_cache;
+	_Atomic long get_attempts;
+	_Atomic long retired;
+
+	// owned by queue_print_stats, used for the ops/sec rate
+	_Alignas(CACHE_LINE) long last_get_count;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+
+// capacity becomes max_count (rounded up to a power of 2) at the next add
+void queue_resize(queue_t *q, int max_count);
+// lets the producer resize between min_count and max_count by itself;
+// call before the producer starts, 0 0 turns it off
+void queue_set_autosize(queue_t *q, int min_count, int max_count);
+
+size_t queue_capacity(queue_t *q);
+// bytes held by rings, old ones not drained yet included
+long queue_mem(queue_t *q);
+
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
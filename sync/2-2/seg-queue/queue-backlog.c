@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <time.h>
+
+#include "queue.h"
+#include "qmon.h"
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+#ifndef VARIANT
+#define VARIANT "?"
+#endif
+
+/*
+ * Memory and throughput of a queue holding a standing backlog, built
+ * against any variant with the common API (see the Makefile):
+ *   fill:   add backlog values to an empty queue_init(backlog)
+ *   steady: ops rounds of one add and one get, the backlog stays full
+ *   drain:  get everything back, checking the order
+ * RSS and heap in use are taken after init, fill and drain.
+ * usage: queue-backlog [backlog] [ops]
+ */
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static long rss_kb(void) {
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (f) {
+		if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long heap_kb(void) {
+	struct mallinfo2 mi = mallinfo2();
+
+	return (mi.uordblks + mi.hblkhd) / 1024;
+}
+
+int main(int argc, char **argv) {
+	int backlog = 1000000;
+	long ops = 10000000, errors = 0;
+	long rss0, heap0;
+	int next_add = 0, next_get = 0, val;
+
+	if (argc > 1)
+		backlog = atoi(argv[1]);
+	if (argc > 2)
+		ops = atol(argv[2]);
+
+	if (backlog < 1 || ops < 0) {
+		printf("usage: %s [backlog] [ops]\n", argv[0]);
+		return -1;
+	}
+
+	// keep the monitor records out of the results unless asked for
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	rss0 = rss_kb();
+	heap0 = heap_kb();
+
+	queue_t *q = queue_init(backlog);
+	long rss_init = rss_kb() - rss0, heap_init = heap_kb() - heap0;
+
+	long start = now_ns();
+	while (next_add < backlog)
+		if (queue_add(q, next_add))
+			next_add++;
+	double fill = backlog / ((now_ns() - start) / 1e9);
+	long rss_full = rss_kb() - rss0, heap_full = heap_kb() - heap0;
+
+	start = now_ns();
+	for (long i = 0; i < ops; i++) {
+		if (!queue_get(q, &val) || val != next_get++)
+			errors++;
+		if (queue_add(q, next_add))
+			next_add++;
+	}
+	double steady = ops / ((now_ns() - start) / 1e9);
+
+	start = now_ns();
+	while (next_get < next_add) {
+		if (!queue_get(q, &val) || val != next_get++)
+			errors++;
+	}
+	double drain = backlog / ((now_ns() - start) / 1e9);
+	long rss_drained = rss_kb() - rss0, heap_drained = heap_kb() - heap0;
+
+	printf("backlog: %-4s %d values: fill %10.0f/s steady %10.0f/s drain %10.0f/s; "
+		"RSS KB init %6ld full %6ld drained %6ld; heap KB init %6ld full %6ld drained %6ld (%.1f B/value)\n",
+		VARIANT, backlog, fill, steady, drain,
+		rss_init, rss_full, rss_drained, heap_init, heap_full, heap_drained,
+		heap_full * 1024.0 / backlog);
+
+	if (errors)
+		printf(RED"ERROR: %ld values missing or out of order" NOCOLOR "\n", errors);
+
+	queue_print_stats(q);
+	queue_destroy(q);
+
+	return errors != 0;
+}
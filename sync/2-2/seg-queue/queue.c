@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+_Static_assert(QUEUE_SEG_VALUES >= 64 && QUEUE_SEG_VALUES <= 1024, "QUEUE_SEG_VALUES out of 64..1024");
+
+#define SEG_SIZE ((sizeof(qseg_t) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
+// callers hold the queue lock
+static qseg_t *seg_alloc(queue_t *q) {
+	qseg_t *s = q->cache;
+
+	if (s) {
+		q->cache = s->next;
+		q->cached--;
+		q->cache_hits++;
+	} else {
+		s = aligned_alloc(CACHE_LINE, SEG_SIZE);
+		if (!s) {
+			printf("Cannot allocate memory for new segment\n");
+			abort();
+		}
+		q->segs++;
+		q->seg_allocs++;
+	}
+
+	s->next = NULL;
+	s->head = s->tail = 0;
+
+	return s;
+}
+
+static void seg_free(queue_t *q, qseg_t *s) {
+	if (q->cached < QUEUE_SEG_CACHE) {
+		s->next = q->cache;
+		q->cache = s;
+		q->cached++;
+		return;
+	}
+
+	free(s);
+	q->segs--;
+	q->seg_frees++;
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = q->count;
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = malloc(sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	q->first = NULL;
+	q->last = NULL;
+	q->cache = NULL;
+	q->cached = 0;
+	q->segs = q->seg_allocs = q->seg_frees = q->cache_hits = 0;
+
+	q->max_count = max_count;
+	q->count = 0;
+
+	q->add_attempts = q->get_attempts = 0;
+	q->add_count = q->get_count = 0;
+
+	pthread_mutex_init(&q->lock, NULL);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	while (q->first) {
+		qseg_t *s = q->first;
+		q->first = s->next;
+		free(s);
+	}
+
+	while (q->cache) {
+		qseg_t *s = q->cache;
+		q->cache = s->next;
+		free(s);
+	}
+
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	pthread_mutex_lock(&q->lock);
+
+	q->add_attempts++;
+	if (q->count == q->max_count) {
+		pthread_mutex_unlock(&q->lock);
+		return 0;
+	}
+
+	qseg_t *s = q->last;
+
+	if (!s || s->tail == QUEUE_SEG_VALUES) {
+		s = seg_alloc(q);
+		if (q->last)
+			q->last->next = s;
+		else
+			q->first = s;
+		q->last = s;
+	}
+
+	s->vals[s->tail++] = val;
+
+	q->count++;
+	q->add_count++;
+
+	pthread_mutex_unlock(&q->lock);
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	pthread_mutex_lock(&q->lock);
+
+	q->get_attempts++;
+	if (q->count == 0) {
+		pthread_mutex_unlock(&q->lock);
+		return 0;
+	}
+
+	qseg_t *s = q->first;
+
+	*val = s->vals[s->head++];
+
+	if (s->head == s->tail) {
+		if (s == q->last) {
+			// empty queue: keep the segment and start over at its beginning
+			s->head = s->tail = 0;
+		} else {
+			q->first = s->next;
+			seg_free(q, s);
+		}
+	}
+
+	q->count--;
+	q->get_count++;
+
+	pthread_mutex_unlock(&q->lock);
+	return 1;
+}
+
+size_t queue_mem(queue_t *q) {
+	pthread_mutex_lock(&q->lock);
+	size_t bytes = q->segs * SEG_SIZE;
+	pthread_mutex_unlock(&q->lock);
+
+	return bytes;
+}
+
+void queue_print_stats(queue_t *q) {
+	pthread_mutex_lock(&q->lock);
+
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld); segments %ld of %d values (%ld KB, %d cached); seg allocs %ld frees %ld cache hits %ld\n",
+		q->count,
+		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
+		q->add_count, q->get_count, q->add_count - q->get_count,
+		q->segs, QUEUE_SEG_VALUES, q->segs * (long)SEG_SIZE / 1024, q->cached,
+		q->seg_allocs, q->seg_frees, q->cache_hits);
+
+	pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,71 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+// values per segment, 64..1024
+#ifndef QUEUE_SEG_VALUES
+#define QUEUE_SEG_VALUES 256
+#endif
+
+// empty segments kept for reuse instead of freed
+#define QUEUE_SEG_CACHE 4
+
+/*
+ * Unrolled list: the queue is a list of segments of QUEUE_SEG_VALUES
+ * values each, filled at last->tail and drained at first->head, so one
+ * allocation serves QUEUE_SEG_VALUES adds and gets walk memory
+ * sequentially. A drained segment goes to a small cache the producer
+ * takes its next one from; the last segment is rewound in place when it
+ * runs empty. Memory is the live segments plus the cache, instead of a
+ * node per value.
+ */
+typedef struct _QueueSegment {
+	struct _QueueSegment *next;
+	int head;	// next value to get
+	int tail;	// next value to add
+	int vals[QUEUE_SEG_VALUES];
+} qseg_t;
+
+typedef struct _Queue {
+    qseg_t *first;
+    qseg_t *last;
+    qmon_entry_t *mon;
+
+    qseg_t *cache;
+    int cached;
+
+    long segs;		// allocated, cache included
+    long seg_allocs;
+    long seg_frees;
+    long cache_hits;
+
+    int count;
+    int max_count;
+    long add_attempts;
+    long get_attempts;
+    long add_count;
+    long get_count;
+    pthread_mutex_t lock;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+// bytes held by segments, cache included
+size_t queue_mem(queue_t *q);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
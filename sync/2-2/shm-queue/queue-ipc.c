@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+ * One producer process, one consumer process, ops int messages moved
+ * through the shared memory queue, a pipe or a Unix stream socket.
+ * The pipe and socket buffers are sized to max_count messages like the
+ * queue; the producer writes one message per write(), the consumer reads
+ * whatever is available. The consumer checks the order and its exit
+ * status reports errors. Prints messages/s and the context switches of
+ * both processes.
+ * usage: queue-ipc [shm|pipe|unix] [ops] [max_count]
+ */
+
+#define READ_BATCH 256
+
+static long ops = 1000000;
+static int max_count = 1024;
+static char name[QUEUE_NAME_MAX];
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int check(int val, int *expected) {
+	int bad = val != *expected;
+
+	*expected = val + 1;
+	return bad;
+}
+
+static int consume_shm(void) {
+	struct timespec pause = { .tv_sec = 0, .tv_nsec = 100000 };
+	queue_t *q;
+	int expected = 0, errors = 0;
+
+	if (!getenv("QMON_FD"))
+		qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+	// the parent creates the queue after forking us
+	while (!(q = queue_attach(name))) {
+		if (errno != ENOENT && errno != EAGAIN) {
+			printf("consumer: cannot attach to %s: %s\n", name, strerror(errno));
+			return 1;
+		}
+		nanosleep(&pause, NULL);
+	}
+
+	for (long i = 0; i < ops; i++) {
+		int val;
+
+		queue_get(q, &val);
+		errors += check(val, &expected);
+	}
+
+	queue_destroy(q);
+	return errors != 0;
+}
+
+static int consume_fd(int fd) {
+	int buf[READ_BATCH];
+	size_t have = 0;
+	int expected = 0, errors = 0;
+	long got = 0;
+
+	while (got < ops) {
+		ssize_t n = read(fd, (char *)buf + have, sizeof(buf) - have);
+		if (n <= 0) {
+			perror("consumer: read");
+			return 1;
+		}
+		have += n;
+
+		// a stream may split a message, keep the tail for the next read
+		size_t whole = have / sizeof(int);
+		for (size_t i = 0; i < whole; i++)
+			errors += check(buf[i], &expected);
+		got += whole;
+
+		have -= whole * sizeof(int);
+		memmove(buf, (char *)buf + whole * sizeof(int), have);
+	}
+
+	return errors != 0;
+}
+
+static void produce_fd(int fd) {
+	for (int v = 0; v < ops; v++) {
+		if (write(fd, &v, sizeof(v)) != sizeof(v)) {
+			perror("producer: write");
+			exit(1);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *mode = argc > 1 ? argv[1] : "shm";
+	struct rusage self, children;
+	int fds[2] = { -1, -1 };
+	int status;
+
+	if (argc > 2)
+		ops = atol(argv[2]);
+	if (argc > 3)
+		max_count = atoi(argv[3]);
+
+	int shm = !strcmp(mode, "shm");
+
+	if ((!shm && strcmp(mode, "pipe") && strcmp(mode, "unix")) || ops < 1 || max_count < 1) {
+		printf("usage: %s [shm|pipe|unix] [ops] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	int bufsize = max_count * sizeof(int);
+
+	if (shm) {
+		snprintf(name, sizeof(name), "/fitos-queue-ipc-%d", getpid());
+	} else if (!strcmp(mode, "pipe")) {
+		if (pipe(fds)) {
+			perror("pipe");
+			return -1;
+		}
+		// rounded up to a page by the kernel
+		fcntl(fds[1], F_SETPIPE_SZ, bufsize);
+	} else {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+			perror("socketpair");
+			return -1;
+		}
+		// doubled for bookkeeping and clamped to a minimum by the kernel
+		setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+		setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	}
+
+	long start = now_ns();
+
+	// fork before any queue (and its monitor thread) exists
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (!pid) {
+		if (shm)
+			_exit(consume_shm());
+		close(fds[1]);
+		_exit(consume_fd(fds[0]));
+	}
+
+	if (shm) {
+		if (!getenv("QMON_FD"))
+			qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+
+		queue_t *q = queue_create(name, max_count);
+		if (!q) {
+			printf("main: cannot create %s: %s\n", name, strerror(errno));
+			kill(pid, SIGKILL);
+			return -1;
+		}
+
+		for (int v = 0; v < ops; v++)
+			queue_add(q, v);
+
+		waitpid(pid, &status, 0);
+		queue_destroy(q);
+	} else {
+		close(fds[0]);
+		produce_fd(fds[1]);
+		waitpid(pid, &status, 0);
+		close(fds[1]);
+	}
+
+	double secs = (now_ns() - start) / 1e9;
+
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+
+	double per = 1e6 / ops;
+
+	printf("ipc: %-5s ops %ld max_count %d: %10.0f msgs/s; per 1M msgs: %8.0f voluntary %8.0f involuntary%s\n",
+		mode, ops, max_count, ops / secs,
+		(self.ru_nvcsw + children.ru_nvcsw) * per,
+		(self.ru_nivcsw + children.ru_nivcsw) * per,
+		WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "" : " ERROR");
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "queue.h"
+
+/*
+ * queue-threads with processes: the parent creates a named queue and
+ * starts the reader and the writer as separate programs (this one,
+ * re-executed) that attach to it by name. The reader checks the values
+ * arrive in order, the parent's monitor reports the rates.
+ * usage: queue-procs [name] [max_count]
+ */
+
+#define RED "\033[41m"
+#define NOCOLOR "\033[0m"
+
+static char name[QUEUE_NAME_MAX] = "/fitos-queue";
+
+static queue_t *attach(const char *role) {
+	queue_t *q = queue_attach(name);
+
+	if (!q) {
+		printf("%s: cannot attach to %s: %s\n", role, name, strerror(errno));
+		exit(1);
+	}
+
+	// only the parent reports
+	qmon_configure(open("/dev/null", O_WRONLY), QMON_JSON, 0);
+	printf("%s [%d %d %d] attached to %s\n", role, getpid(), getppid(), gettid(), name);
+
+	return q;
+}
+
+static void reader(void) {
+	queue_t *q = attach("reader");
+	int expected = 0;
+
+	while (1) {
+		int val = -1;
+
+		queue_get(q, &val);
+		if (expected != val)
+			printf(RED"ERROR: get value is %d but expected - %d" NOCOLOR "\n", val, expected);
+
+		expected = val + 1;
+	}
+}
+
+static void writer(void) {
+	queue_t *q = attach("writer");
+
+	for (int i = 0; ; i++)
+		queue_add(q, i);
+}
+
+static pid_t spawn(const char *role) {
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid)
+		return pid;
+
+	// do not outlive the parent
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	execl("/proc/self/exe", "queue-procs", role, name, (char *)NULL);
+	perror("execl");
+	_exit(1);
+}
+
+static void on_signal(int sig) {
+	queue_unlink(name);
+	_exit(0);
+}
+
+int main(int argc, char **argv) {
+	int max_count = 1000;
+
+	if (argc > 2 && argv[1][0] == '-') {
+		snprintf(name, sizeof(name), "%s", argv[2]);
+		if (!strcmp(argv[1], "-reader"))
+			reader();
+		else if (!strcmp(argv[1], "-writer"))
+			writer();
+		return 1;
+	}
+
+	if (argc > 1)
+		snprintf(name, sizeof(name), "%s", argv[1]);
+	if (argc > 2)
+		max_count = atoi(argv[2]);
+
+	if (name[0] != '/' || max_count < 1) {
+		printf("usage: %s [/name] [max_count]\n", argv[0]);
+		return -1;
+	}
+
+	printf("main [%d %d %d]\n", getpid(), getppid(), gettid());
+
+	// left behind by a run that was killed
+	queue_unlink(name);
+
+	queue_t *q = queue_create(name, max_count);
+	if (!q) {
+		printf("main: cannot create %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	spawn("-writer");
+	spawn("-reader");
+
+	// the children only stop when killed
+	while (wait(NULL) > 0)
+		;
+
+	queue_destroy(q);
+
+	return 0;
+}
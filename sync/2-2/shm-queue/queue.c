@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "queue.h"
+
+// called by the monitor thread; the counters are read without the lock
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	qshared_t *shm = ((queue_t *)arg)->shm;
+
+	s->add_count = s->add_attempts = shm->add_count;
+	s->get_count = s->get_attempts = shm->get_count;
+	s->count = s->add_count - s->get_count;
+}
+
+static queue_t *handle_new(qshared_t *shm, size_t map_size, int creator) {
+	queue_t *q = malloc(sizeof(queue_t));
+	if (!q) {
+		munmap(shm, map_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	q->shm = shm;
+	q->map_size = map_size;
+	q->name[0] = '\0';
+	q->creator = creator;
+
+	q->last_get_count = shm->get_count;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+// sizes the object behind fd and initializes the region in it
+static queue_t *region_init(int fd, int max_count) {
+	size_t size = sizeof(qshared_t) + max_count * sizeof(int);
+
+	if (ftruncate(fd, size))
+		return NULL;
+
+	qshared_t *shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	shm->max_count = max_count;
+	shm->size = size;
+	shm->add_waiters = shm->get_waiters = 0;
+	shm->head = shm->tail = 0;
+	shm->add_count = shm->get_count = 0;
+	shm->wakeups = shm->owner_died = 0;
+
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
+
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+
+	pthread_mutex_init(&shm->mutex, &mattr);
+	pthread_cond_init(&shm->cond_non_full, &cattr);
+	pthread_cond_init(&shm->cond_non_empty, &cattr);
+
+	pthread_mutexattr_destroy(&mattr);
+	pthread_condattr_destroy(&cattr);
+
+	// attachers check this before touching anything else
+	atomic_store_explicit(&shm->magic, QUEUE_SHM_MAGIC, memory_order_release);
+
+	return handle_new(shm, size, 1);
+}
+
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	int fd = memfd_create("queue", MFD_CLOEXEC);
+	if (fd < 0) {
+		perror("queue_init: memfd_create");
+		abort();
+	}
+
+	queue_t *q = region_init(fd, max_count);
+	if (!q) {
+		perror("queue_init: cannot map the queue");
+		abort();
+	}
+	close(fd);
+
+	return q;
+}
+
+queue_t* queue_create(const char *name, int max_count) {
+	assert(max_count > 0);
+
+	if (strlen(name) >= QUEUE_NAME_MAX) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		return NULL;
+
+	queue_t *q = region_init(fd, max_count);
+	int err = errno;
+
+	close(fd);
+	if (!q) {
+		shm_unlink(name);
+		errno = err;
+		return NULL;
+	}
+
+	strcpy(q->name, name);
+
+	return q;
+}
+
+queue_t* queue_attach(const char *name) {
+	struct stat st;
+
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	// the creator has not sized it yet
+	if (st.st_size < (off_t)sizeof(qshared_t)) {
+		close(fd);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	qshared_t *shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	uint32_t magic = atomic_load_explicit(&shm->magic, memory_order_acquire);
+	if (magic != QUEUE_SHM_MAGIC || shm->size != (size_t)st.st_size) {
+		munmap(shm, st.st_size);
+		errno = magic ? EINVAL : EAGAIN;
+		return NULL;
+	}
+
+	return handle_new(shm, st.st_size, 0);
+}
+
+int queue_unlink(const char *name) {
+	return shm_unlink(name);
+}
+
+// the region outlives this process as long as others still map it, so the
+// mutex and condvars are not destroyed; the creator removes the name
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	if (q->creator && q->name[0])
+		shm_unlink(q->name);
+
+	munmap(q->shm, q->map_size);
+	free(q);
+}
+
+/*
+ * Robust mutex: if the previous owner died holding it we get it anyway.
+ * A critical section publishes its slot with the final head/tail
+ * increment, so the region is consistent at any point a process can die.
+ */
+static void owner_died(qshared_t *shm) {
+	shm->owner_died++;
+	pthread_mutex_consistent(&shm->mutex);
+}
+
+static void queue_lock(qshared_t *shm) {
+	int err = pthread_mutex_lock(&shm->mutex);
+
+	if (err == EOWNERDEAD)
+		owner_died(shm);
+	else if (err) {
+		printf("queue_lock: pthread_mutex_lock() failed: %s\n", strerror(err));
+		abort();
+	}
+}
+
+static void queue_wait(qshared_t *shm, pthread_cond_t *cond) {
+	if (pthread_cond_wait(cond, &shm->mutex) == EOWNERDEAD)
+		owner_died(shm);
+}
+
+int queue_add(queue_t *q, int val) {
+	qshared_t *shm = q->shm;
+
+	queue_lock(shm);
+
+	while (shm->tail - shm->head == shm->max_count) {
+		shm->add_waiters++;
+		queue_wait(shm, &shm->cond_non_full);
+		shm->add_waiters--;
+	}
+
+	shm->slots[shm->tail % shm->max_count] = val;
+	shm->tail++;
+	shm->add_count++;
+
+	if (shm->get_waiters) {
+		pthread_cond_signal(&shm->cond_non_empty);
+		shm->wakeups++;
+	}
+	pthread_mutex_unlock(&shm->mutex);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	qshared_t *shm = q->shm;
+
+	queue_lock(shm);
+
+	while (shm->tail == shm->head) {
+		shm->get_waiters++;
+		queue_wait(shm, &shm->cond_non_empty);
+		shm->get_waiters--;
+	}
+
+	*val = shm->slots[shm->head % shm->max_count];
+	shm->head++;
+	shm->get_count++;
+
+	if (shm->add_waiters) {
+		pthread_cond_signal(&shm->cond_non_full);
+		shm->wakeups++;
+	}
+	pthread_mutex_unlock(&shm->mutex);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	qshared_t *shm = q->shm;
+	struct timespec now;
+
+	long add_count = shm->add_count, get_count = shm->get_count;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = get_count;
+	q->last_ts = now;
+
+	printf("queue stats: %s current size %ld/%d; counts (%ld %ld %ld); wakeups %ld; owner died %ld; %.0f ops/s\n",
+		q->name[0] ? q->name : "(anonymous)",
+		add_count - get_count, shm->max_count,
+		add_count, get_count, add_count - get_count,
+		shm->wakeups, shm->owner_died, ops);
+}
@@ -0,0 +1,89 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+// "FQSH", written last by the creator once the region is initialized
+#define QUEUE_SHM_MAGIC 0x48535146u
+#define QUEUE_NAME_MAX 64
+
+/*
+ * Bounded queue living in a shared memory region, usable from several
+ * processes. Everything in the region is position independent: values
+ * sit in a slot array indexed by head/tail counters (no pointers), and
+ * the mutex and condvars are PTHREAD_PROCESS_SHARED. The mutex is robust,
+ * so a process dying inside the short critical section does not block
+ * the others.
+ *
+ * queue_create() makes a named region (shm_open, name like "/myqueue")
+ * that other processes open with queue_attach(); queue_init() makes an
+ * anonymous one (memfd) shared with children forked afterwards.
+ * queue_add/queue_get block while the queue is full/empty.
+ */
+typedef struct _QueueShared {
+	_Atomic uint32_t magic;
+	int max_count;
+	size_t size;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_non_full;
+	pthread_cond_t cond_non_empty;
+	int add_waiters;
+	int get_waiters;
+
+	// slot indices are head/tail modulo max_count
+	unsigned long head;
+	unsigned long tail;
+
+	// queue statistics, updated under the mutex
+	long add_count;
+	long get_count;
+	long wakeups;
+	long owner_died;
+
+	_Alignas(CACHE_LINE) int slots[];
+} qshared_t;
+
+// per-process handle
+typedef struct _Queue {
+	qshared_t *shm;
+	size_t map_size;
+	char name[QUEUE_NAME_MAX];	// empty for anonymous queues
+	int creator;
+
+	qmon_entry_t *mon;
+
+	// owned by queue_print_stats, used for the rate
+	long last_get_count;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+
+// NULL with errno set on failure; EEXIST if the name is taken
+queue_t* queue_create(const char *name, int max_count);
+// NULL with errno: ENOENT no such queue, EAGAIN not initialized yet,
+// EINVAL not a queue
+queue_t* queue_attach(const char *name);
+int queue_unlink(const char *name);
+
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p <<= 1;
+
+	return p;
+}
+
+// single-writer counter: no RMW needed, the monitor only reads it
+static inline void stat_inc(_Atomic long *c) {
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+		memory_order_relaxed);
+}
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->add_count = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	s->get_count = atomic_load_explicit(&q->head, memory_order_relaxed);
+	s->add_attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+	s->get_attempts = atomic_load_explicit(&q->get_attempts, memory_order_relaxed);
+	s->count = s->add_count - s->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	assert(max_count > 0);
+
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	size_t size = round_up_pow2(max_count);
+
+	q->buf = malloc(size * sizeof(int));
+	if (!q->buf) {
+		printf("Cannot allocate memory for queue buffer\n");
+		abort();
+	}
+
+	q->mask = size - 1;
+	q->max_count = size;
+
+	atomic_store(&q->tail, 0);
+	atomic_store(&q->head, 0);
+	q->head_cache = q->tail_cache = 0;
+
+	atomic_store(&q->add_attempts, 0);
+	atomic_store(&q->get_attempts, 0);
+
+	q->last_get_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &q->last_ts);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	free(q->buf);
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	stat_inc(&q->add_attempts);
+
+	if (tail - q->head_cache > q->mask) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->head_cache > q->mask)
+			return 0;
+	}
+
+	q->buf[tail & q->mask] = val;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	stat_inc(&q->get_attempts);
+
+	if (head == q->tail_cache) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_cache)
+			return 0;
+	}
+
+	*val = q->buf[head & q->mask];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	struct timespec now;
+
+	long get_count = atomic_load_explicit(&q->head, memory_order_relaxed);
+	long add_count = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	long add_attempts = atomic_load_explicit(&q->add_attempts, memory_order_relaxed);
+	long get_attempts = atomic_load_explicit(&q->get_attempts, memory_order_relaxed);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = (now.tv_sec - q->last_ts.tv_sec) + (now.tv_nsec - q->last_ts.tv_nsec) / 1e9;
+	double ops = dt > 0 ? (get_count - q->last_get_count) / dt : 0;
+
+	q->last_get_count = get_count;
+	q->last_ts = now;
+
+	printf("queue stats: current size %ld; attempts: (%ld %ld %ld); counts (%ld %ld %ld); %.0f ops/s\n",
+		add_count - get_count,
+		add_attempts, get_attempts, add_attempts - get_attempts,
+		add_count, get_count, add_count - get_count, ops);
+}
@@ -0,0 +1,54 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+/*
+ * Single-producer/single-consumer ring: exactly one thread may call
+ * queue_add and exactly one thread may call queue_get.
+ * Each side keeps a private copy of the other side's index and reloads
+ * it only when the copy says the ring is full (or empty).
+ */
+typedef struct _Queue {
+	int *buf;
+	size_t mask;
+
+	qmon_entry_t *mon;
+
+	int max_count;
+
+	// written by the producer only
+	_Alignas(CACHE_LINE) _Atomic size_t tail;
+	size_t head_cache;
+	_Atomic long add_attempts;
+
+	// written by the consumer only
+	_Alignas(CACHE_LINE) _Atomic size_t head;
+	size_t tail_cache;
+	_Atomic long get_attempts;
+
+	// owned by queue_print_stats, used for the ops/sec rate
+	_Alignas(CACHE_LINE) long last_get_count;
+	struct timespec last_ts;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <assert.h>
+
+#include "queue.h"
+
+// called by the monitor thread
+static void queue_sample(void *arg, qmon_sample_t *s) {
+	queue_t *q = (queue_t *)arg;
+
+	s->count = atomic_load(&q->count);
+	s->add_attempts = q->add_attempts;
+	s->get_attempts = q->get_attempts;
+	s->add_count = q->add_count;
+	s->get_count = q->get_count;
+}
+
+queue_t* queue_init(int max_count) {
+	queue_t *q = aligned_alloc(CACHE_LINE, sizeof(queue_t));
+	if (!q) {
+		printf("Cannot allocate memory for a queue\n");
+		abort();
+	}
+
+	qnode_t *dummy = malloc(sizeof(qnode_t));
+	if (!dummy) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	dummy->next = NULL;
+
+	q->first = q->last = dummy;
+	q->max_count = max_count;
+	atomic_store(&q->count, 0);
+
+	q->add_attempts = q->get_attempts = 0;
+	q->add_count = q->get_count = 0;
+
+	pthread_mutex_init(&q->head_lock, NULL);
+	pthread_mutex_init(&q->tail_lock, NULL);
+
+	q->mon = qmon_register(q, queue_sample);
+
+	return q;
+}
+
+void queue_destroy(queue_t *q) {
+	qmon_unregister(q->mon);
+
+	qnode_t *current = q->first;
+	while (current != NULL) {
+		qnode_t *temp = current;
+		current = current->next;
+		free(temp);
+	}
+
+	pthread_mutex_destroy(&q->head_lock);
+	pthread_mutex_destroy(&q->tail_lock);
+	free(q);
+}
+
+int queue_add(queue_t *q, int val) {
+	qnode_t *new = malloc(sizeof(qnode_t));
+	if (!new) {
+		printf("Cannot allocate memory for new node\n");
+		abort();
+	}
+	new->val = val;
+	new->next = NULL;
+
+	pthread_mutex_lock(&q->tail_lock);
+	q->add_attempts++;
+
+	// only producers increase count and they are serialized here,
+	// so it cannot grow between the check and the increment
+	if (atomic_load(&q->count) == q->max_count) {
+		pthread_mutex_unlock(&q->tail_lock);
+		free(new);
+		return 0;
+	}
+
+	__atomic_store_n(&q->last->next, new, __ATOMIC_RELEASE);
+	q->last = new;
+
+	atomic_fetch_add(&q->count, 1);
+	q->add_count++;
+
+	pthread_mutex_unlock(&q->tail_lock);
+	return 1;
+}
+
+int queue_get(queue_t *q, int *val) {
+	pthread_mutex_lock(&q->head_lock);
+	q->get_attempts++;
+
+	qnode_t *dummy = q->first;
+	qnode_t *next = __atomic_load_n(&dummy->next, __ATOMIC_ACQUIRE);
+	if (!next) {
+		pthread_mutex_unlock(&q->head_lock);
+		return 0;
+	}
+
+	// next becomes the new dummy
+	*val = next->val;
+	q->first = next;
+
+	atomic_fetch_sub(&q->count, 1);
+	q->get_count++;
+
+	pthread_mutex_unlock(&q->head_lock);
+
+	free(dummy);
+	return 1;
+}
+
+void queue_print_stats(queue_t *q) {
+	printf("queue stats: current size %d; attempts: (%ld %ld %ld); counts (%ld %ld %ld)\n",
+		atomic_load(&q->count),
+		q->add_attempts, q->get_attempts, q->add_attempts - q->get_attempts,
+		q->add_count, q->get_count, q->add_count -q->get_count);
+}
@@ -0,0 +1,53 @@
+#ifndef __FITOS_QUEUE_H__
+#define __FITOS_QUEUE_H__
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "qmon.h"
+
+#define CACHE_LINE 64
+
+typedef struct _QueueNode {
+	int val;
+	struct _QueueNode *next;
+} qnode_t;
+
+/*
+ * Two-lock queue (Michael & Scott): first points to a dummy node, so
+ * producers only touch last under tail_lock and consumers only touch
+ * first under head_lock. count is the only field shared by both sides.
+ */
+typedef struct _Queue {
+	qmon_entry_t *mon;
+	int max_count;
+
+	_Alignas(CACHE_LINE) _Atomic int count;
+
+	// consumer side
+	_Alignas(CACHE_LINE) pthread_mutex_t head_lock;
+	qnode_t *first;
+	long get_attempts;
+	long get_count;
+
+	// producer side
+	_Alignas(CACHE_LINE) pthread_mutex_t tail_lock;
+	qnode_t *last;
+	long add_attempts;
+	long add_count;
+} queue_t;
+
+queue_t* queue_init(int max_count);
+void queue_destroy(queue_t *q);
+int queue_add(queue_t *q, int val);
+int queue_get(queue_t *q, int *val);
+void queue_print_stats(queue_t *q);
+
+#endif		// __FITOS_QUEUE_H__
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "qmon.h"
+
+struct _QmonEntry {
+	void *queue;
+	qmon_sample_fn sample;
+	unsigned long id;
+
+	// previous sample, for the per-interval rates
+	qmon_sample_t prev;
+	struct timespec prev_ts;
+
+	struct _QmonEntry *next;
+};
+
+// the registry; the monitor holds the lock while sampling
+static pthread_mutex_t qmon_lock = PTHREAD_MUTEX_INITIALIZER;
+static qmon_entry_t *qmon_entries;
+static unsigned long qmon_ids;
+
+static int qmon_fd = 1;
+static int qmon_format = QMON_JSON;
+static int qmon_interval_ms = 1000;
+static int qmon_csv_header;
+
+static pthread_once_t qmon_once = PTHREAD_ONCE_INIT;
+static pthread_t qmon_tid;
+
+// every optional field starts as not tracked
+static void qmon_sample_init(qmon_sample_t *s) {
+	memset(s, 0, sizeof(*s));
+	s->add_bytes = s->get_bytes = -1;
+	s->drops = -1;
+	s->lat_n = -1;
+	s->allocs = s->lock_ops = s->wakeups = s->syscalls = -1;
+}
+
+// per second over the interval; lock_ops per element added or got
+static void qmon_costs(const qmon_sample_t *s, const qmon_sample_t *p, double dt,
+		double *allocs, double *lock_ops, double *wakeups, double *syscalls) {
+	long moved = (s->add_count - p->add_count) + (s->get_count - p->get_count);
+
+	*allocs = (s->allocs - p->allocs) / dt;
+	*lock_ops = moved ? (double)(s->lock_ops - p->lock_ops) / moved : 0;
+	*wakeups = (s->wakeups - p->wakeups) / dt;
+	*syscalls = (s->syscalls - p->syscalls) / dt;
+}
+
+static double ts_diff(const struct timespec *a, const struct timespec *b) {
+	return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static void qmon_write(qmon_entry_t *e, const qmon_sample_t *s, const struct timespec *now) {
+	const qmon_sample_t *p = &e->prev;
+	double dt = ts_diff(now, &e->prev_ts);
+	double ts = now->tv_sec + now->tv_nsec / 1e9;
+
+	if (dt <= 0)
+		dt = 1e-9;
+
+	double adds = (s->add_count - p->add_count) / dt;
+	double gets = (s->get_count - p->get_count) / dt;
+	double add_fails = ((s->add_attempts - s->add_count) - (p->add_attempts - p->add_count)) / dt;
+	double get_fails = ((s->get_attempts - s->get_count) - (p->get_attempts - p->get_count)) / dt;
+	double allocs, lock_ops, wakeups, syscalls;
+
+	qmon_costs(s, p, dt, &allocs, &lock_ops, &wakeups, &syscalls);
+
+	if (qmon_format == QMON_CSV) {
+		char bytes[64] = ",", lat[160] = ",,,,", drops[32] = "";
+		char costs[4][32] = { "", "", "", "" };
+
+		if (!qmon_csv_header) {
+			dprintf(qmon_fd, "ts,queue,count,adds_per_s,gets_per_s,add_fails_per_s,get_fails_per_s,"
+				"add_bytes_per_s,get_bytes_per_s,lat_n,lat_p50_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,"
+				"drops_per_s,allocs_per_s,lock_ops_per_elem,wakeups_per_s,syscalls_per_s\n");
+			qmon_csv_header = 1;
+		}
+
+		if (s->add_bytes >= 0)
+			snprintf(bytes, sizeof(bytes), "%.0f,%.0f",
+				(s->add_bytes - p->add_bytes) / dt, (s->get_bytes - p->get_bytes) / dt);
+		if (s->lat_n >= 0)
+			snprintf(lat, sizeof(lat), "%ld,%ld,%ld,%ld,%ld",
+				s->lat_n, s->lat_p50_ns, s->lat_p99_ns, s->lat_p999_ns, s->lat_max_ns);
+		if (s->drops >= 0)
+			snprintf(drops, sizeof(drops), "%.0f", (s->drops - p->drops) / dt);
+		if (s->allocs >= 0)
+			snprintf(costs[0], sizeof(costs[0]), "%.0f", allocs);
+		if (s->lock_ops >= 0)
+			snprintf(costs[1], sizeof(costs[1]), "%.3f", lock_ops);
+		if (s->wakeups >= 0)
+			snprintf(costs[2], sizeof(costs[2]), "%.0f", wakeups);
+		if (s->syscalls >= 0)
+			snprintf(costs[3], sizeof(costs[3]), "%.0f", syscalls);
+
+		dprintf(qmon_fd, "%.3f,%lu,%ld,%.0f,%.0f,%.0f,%.0f,%s,%s,%s,%s,%s,%s,%s\n",
+			ts, e->id, s->count, adds, gets, add_fails, get_fails, bytes, lat, drops,
+			costs[0], costs[1], costs[2], costs[3]);
+		return;
+	}
+
+	char bytes[96] = "", lat[160] = "", drops[48] = "", costs[160] = "";
+	int n = 0;
+
+	if (s->add_bytes >= 0)
+		snprintf(bytes, sizeof(bytes), ",\"add_bytes_per_s\":%.0f,\"get_bytes_per_s\":%.0f",
+			(s->add_bytes - p->add_bytes) / dt, (s->get_bytes - p->get_bytes) / dt);
+	if (s->lat_n >= 0)
+		snprintf(lat, sizeof(lat),
+			",\"lat_n\":%ld,\"lat_p50_ns\":%ld,\"lat_p99_ns\":%ld,\"lat_p999_ns\":%ld,\"lat_max_ns\":%ld",
+			s->lat_n, s->lat_p50_ns, s->lat_p99_ns, s->lat_p999_ns, s->lat_max_ns);
+	if (s->drops >= 0)
+		snprintf(drops, sizeof(drops), ",\"drops_per_s\":%.0f", (s->drops - p->drops) / dt);
+	if (s->allocs >= 0)
+		n += snprintf(costs + n, sizeof(costs) - n, ",\"allocs_per_s\":%.0f", allocs);
+	if (s->lock_ops >= 0)
+		n += snprintf(costs + n, sizeof(costs) - n, ",\"lock_ops_per_elem\":%.3f", lock_ops);
+	if (s->wakeups >= 0)
+		n += snprintf(costs + n, sizeof(costs) - n, ",\"wakeups_per_s\":%.0f", wakeups);
+	if (s->syscalls >= 0)
+		n += snprintf(costs + n, sizeof(costs) - n, ",\"syscalls_per_s\":%.0f", syscalls);
+
+	dprintf(qmon_fd, "{\"ts\":%.3f,\"queue\":%lu,\"count\":%ld,\"adds_per_s\":%.0f,\"gets_per_s\":%.0f,"
+		"\"add_fails_per_s\":%.0f,\"get_fails_per_s\":%.0f%s%s%s%s}\n",
+		ts, e->id, s->count, adds, gets, add_fails, get_fails, bytes, lat, drops, costs);
+}
+
+static void *qmon_thread(void *arg) {
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (1) {
+		pthread_mutex_lock(&qmon_lock);
+		long period_ns = qmon_interval_ms * 1000000L;
+		pthread_mutex_unlock(&qmon_lock);
+
+		next.tv_sec += period_ns / 1000000000L;
+		next.tv_nsec += period_ns % 1000000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		pthread_mutex_lock(&qmon_lock);
+		for (qmon_entry_t *e = qmon_entries; e; e = e->next) {
+			qmon_sample_t s;
+			struct timespec now;
+
+			qmon_sample_init(&s);
+			e->sample(e->queue, &s);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+
+			qmon_write(e, &s, &now);
+			e->prev = s;
+			e->prev_ts = now;
+		}
+		pthread_mutex_unlock(&qmon_lock);
+	}
+
+	return NULL;
+}
+
+static void qmon_start(void) {
+	int err;
+	char *env;
+
+	pthread_mutex_lock(&qmon_lock);
+	if ((env = getenv("QMON_FD")))
+		qmon_fd = atoi(env);
+	if ((env = getenv("QMON_FORMAT")) && !strcasecmp(env, "csv"))
+		qmon_format = QMON_CSV;
+	if ((env = getenv("QMON_INTERVAL_MS")) && atoi(env) > 0)
+		qmon_interval_ms = atoi(env);
+	pthread_mutex_unlock(&qmon_lock);
+
+	err = pthread_create(&qmon_tid, NULL, qmon_thread, NULL);
+	if (err) {
+		printf("qmon_start: pthread_create() failed: %s\n", strerror(err));
+		abort();
+	}
+	pthread_detach(qmon_tid);
+}
+
+void qmon_configure(int fd, int format, int interval_ms) {
+	pthread_once(&qmon_once, qmon_start);
+
+	pthread_mutex_lock(&qmon_lock);
+	if (fd >= 0)
+		qmon_fd = fd;
+	if (format != qmon_format)
+		qmon_csv_header = 0;
+	qmon_format = format;
+	if (interval_ms > 0)
+		qmon_interval_ms = interval_ms;
+	pthread_mutex_unlock(&qmon_lock);
+}
+
+qmon_entry_t *qmon_register(void *queue, qmon_sample_fn sample) {
+	qmon_entry_t *e = malloc(sizeof(qmon_entry_t));
+	if (!e) {
+		printf("Cannot allocate memory for a monitor entry\n");
+		abort();
+	}
+
+	pthread_once(&qmon_once, qmon_start);
+
+	e->queue = queue;
+	e->sample = sample;
+
+	pthread_mutex_lock(&qmon_lock);
+	e->id = ++qmon_ids;
+
+	// the first interval starts now
+	qmon_sample_init(&e->prev);
+	sample(queue, &e->prev);
+	clock_gettime(CLOCK_MONOTONIC, &e->prev_ts);
+
+	e->next = qmon_entries;
+	qmon_entries = e;
+	pthread_mutex_unlock(&qmon_lock);
+
+	return e;
+}
+
+void qmon_unregister(qmon_entry_t *e) {
+	pthread_mutex_lock(&qmon_lock);
+	for (qmon_entry_t **p = &qmon_entries; *p; p = &(*p)->next) {
+		if (*p == e) {
+			*p = e->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&qmon_lock);
+
+	free(e);
+}
@@ -0,0 +1,63 @@
+#ifndef __FITOS_QMON_H__
+#define __FITOS_QMON_H__
+
+/*
+ * Process-wide queue monitor.
+ *
+ * Instead of one qmonitor thread per queue, queues register here and a
+ * single thread samples all of them once per interval. For every queue it
+ * writes one record with the rates over the last interval (not cumulative
+ * counts), as JSON lines or CSV.
+ *
+ * Defaults come from the environment:
+ *   QMON_FD           output fd (1)
+ *   QMON_FORMAT       "json" or "csv" (json)
+ *   QMON_INTERVAL_MS  sampling period (1000)
+ * qmon_configure() overrides them.
+ */
+
+enum {
+	QMON_JSON,
+	QMON_CSV,
+};
+
+// cumulative counters of one queue, filled in by its sample callback
+typedef struct _QmonSample {
+	long count;
+	long add_attempts;
+	long get_attempts;
+	long add_count;
+	long get_count;
+
+	// payload bytes moved, < 0 if not tracked
+	long add_bytes;
+	long get_bytes;
+
+	// values discarded by a full-queue policy, < 0 if not tracked
+	long drops;
+
+	// enqueue->dequeue latency over the interval; lat_n < 0 if not tracked
+	long lat_n;
+	long lat_p50_ns;
+	long lat_p99_ns;
+	long lat_p999_ns;
+	long lat_max_ns;
+
+	// cost counters, each < 0 if not tracked
+	long allocs;	// mallocs on the add path
+	long lock_ops;	// lock acquisitions, reported per element added or got
+	long wakeups;	// sleeping threads woken
+	long syscalls;	// futex/eventfd calls made by the queue
+} qmon_sample_t;
+
+typedef void (*qmon_sample_fn)(void *queue, qmon_sample_t *s);
+
+typedef struct _QmonEntry qmon_entry_t;
+
+void qmon_configure(int fd, int format, int interval_ms);
+qmon_entry_t *qmon_register(void *queue, qmon_sample_fn sample);
+
+// once this returns the monitor no longer touches the queue
+void qmon_unregister(qmon_entry_t *e);
+
+#endif		// __FITOS_QMON_H__